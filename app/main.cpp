@@ -1,8 +1,12 @@
 #include "Point.h"
 
+#include "MapTools.h"
 #include "Noise.h"
+#include "NoiseGraph.h"
 #include <chrono>
+#include <cmath>
 #include <iostream>
+#include <vector>
 
 using namespace mist;
 
@@ -29,6 +33,112 @@ auto timeNoise() -> long
     return dt.count();
 }
 
+auto timeNoiseBatch() -> long
+{
+    PerlinNoise2 perlin;
+    OctaveNoise2 octaves(perlin);
+    octaves.setNumOctaves(2);
+
+    static constexpr auto N = 2048;
+    std::vector<Point2d>  points(N, Point2d {0.4, 1.3});
+    std::vector<double>   row(N);
+    double                out = 0;
+
+    auto t0 = std::chrono::system_clock::now();
+
+    for (int i = 0; i < N; ++i) {
+        octaves.sampleMany(points, row);
+        out += row[0];
+    }
+
+    auto t1 = std::chrono::system_clock::now();
+    auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0);
+    std::cout << "Time: " << dt.count() << "ms\n";
+
+    return dt.count();
+}
+
+template <class Noise> auto timeWarpedNoise(Noise &noise) -> long
+{
+    static constexpr auto N = 1024;
+    double                out = 0;
+
+    auto t0 = std::chrono::system_clock::now();
+
+    for (int i = 0; i < N * N; ++i)
+        out += noise.sample({i * 0.001, 1.3});
+
+    auto t1 = std::chrono::system_clock::now();
+    auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0);
+    std::cout << "Time: " << dt.count() << "ms (" << out << ")\n";
+
+    return dt.count();
+}
+
+template <class F> auto timeMs(F func) -> long
+{
+    auto t0 = std::chrono::system_clock::now();
+    func();
+    auto t1 = std::chrono::system_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+}
+
+// Times the MapTools algorithms on a large map stored with the given layout
+template <class Layout> auto timeMapTools(const char *layoutName) -> void
+{
+    static constexpr auto N = 2048;
+
+    Matrix<double, Layout> map(N, N);
+    map.generate([](const Point2i &p) {
+        return std::sin(p.x * 0.013) * std::cos(p.y * 0.007);
+    });
+
+    double out = 0;
+
+    const auto gradient = timeMs([&] {
+        out += calculateGradient(map)[{N / 2, N / 2}].x;
+    });
+
+    AStar<double, Layout> astar(map);
+    const auto            route = timeMs([&] {
+        astar.setBlockValue(0.9).calculate({N / 2, N / 2});
+        out += static_cast<double>(astar.route({10, N - 10}).size());
+    });
+
+    std::vector<Point2i> strokes;
+    for (int i = 0; i < 200; ++i)
+        strokes.push_back({(i * 37) % N, (i * 101) % N});
+
+    MapBrush<double, Layout> brush(map, 48);
+    const auto               brushing = timeMs([&] {
+        brush.atPoints(strokes, [&](const Point2i &p, double r) {
+            map[p] += 0.001 * r;
+        });
+    });
+
+    // a small edit, brought into the gradient and costs incrementally and from scratch
+    map.trackModifiedTiles(64);
+    auto       grad = calculateGradient(map);
+    const auto revision = map.getRevision();
+    astar.calculate({N / 2, N / 2});
+
+    brush.atPoints(std::vector<Point2i> {{N / 4, N / 4}}, [&](const Point2i &p, double r) {
+        map[p] -= 0.001 * r;
+    });
+    const auto update = timeMs([&] {
+        updateGradient(map, grad, revision);
+        astar.update();
+    });
+    const auto recalculation = timeMs([&] {
+        out += calculateGradient(map)[{N / 4, N / 4}].x;
+        astar.calculate({N / 2, N / 2});
+    });
+
+    std::cout << layoutName << ": gradient " << gradient << "ms, AStar " << route
+              << "ms, brush " << brushing << "ms, edit update " << update << "ms vs "
+              << recalculation << "ms (" << out << ")\n";
+}
+
 int main()
 {
     try {
@@ -39,6 +149,48 @@ int main()
             total += timeNoise();
 
         std::cout << "\n *** Avg: " << (total / N) << "ms\n";
+
+        const auto bestLevel = getNoiseSimdLevel();
+        for (auto level : {SimdLevel::None, SimdLevel::Sse41, SimdLevel::Avx2}) {
+            if (level > bestLevel) continue;
+            setNoiseSimdLevel(level);
+
+            std::cout << "\nBatch, SIMD level " << static_cast<int>(level) << "\n";
+            total = 0;
+            for (int i = 0; i < 5; ++i)
+                total += timeNoiseBatch();
+
+            std::cout << "\n *** Avg: " << (total / N) << "ms\n";
+        }
+        setNoiseSimdLevel(bestLevel);
+
+        PerlinNoise2       perlin;
+        OctaveNoise2       octaves(perlin);
+        DomainWarpedNoise2 warped(octaves);
+        octaves.setNumOctaves(2);
+
+        std::cout << "\nWarped octaves, virtual chain\n";
+        total = 0;
+        for (int i = 0; i < 5; ++i)
+            total += timeWarpedNoise(warped);
+
+        std::cout << "\n *** Avg: " << (total / N) << "ms\n";
+
+        compose::Warp<compose::Octave<PerlinNoise2>> graph;
+        graph.source().setNumOctaves(2);
+
+        std::cout << "\nWarped octaves, composed graph\n";
+        total = 0;
+        for (int i = 0; i < 5; ++i)
+            total += timeWarpedNoise(graph);
+
+        std::cout << "\n *** Avg: " << (total / N) << "ms\n";
+
+        std::cout << "\nMatrix layouts\n";
+        timeMapTools<RowMajorLayout>("Row-major");
+        timeMapTools<PaddedRowLayout<64>>("Padded rows");
+        timeMapTools<TiledLayout<64>>("Tiled 64");
+        timeMapTools<MortonLayout<64>>("Morton 64");
     }
 
     catch (std::exception &e) {
@@ -46,3 +46,5 @@ class HelloConan(ConanFile):
 
     def package_info(self):
         self.cpp_info.libs = ["mist"]
+        if self.settings.os in ["Linux", "FreeBSD"]:
+            self.cpp_info.system_libs = ["pthread"]
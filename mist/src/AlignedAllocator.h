@@ -0,0 +1,47 @@
+#ifndef ALIGNEDALLOCATOR_H_
+#define ALIGNEDALLOCATOR_H_
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+namespace mist
+{
+
+// Allocates memory aligned to Alignment bytes, e.g. for aligned SIMD loads and stores
+template <typename T, std::size_t Alignment = 64> class AlignedAllocator
+{
+    static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1)) == 0);
+
+public:
+    using value_type = T;
+
+    template <typename U> struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+    [[nodiscard]] auto allocate(std::size_t n) -> T *
+    {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_array_new_length();
+
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t {Alignment}));
+    }
+
+    auto deallocate(T *p, std::size_t) noexcept -> void
+    {
+        ::operator delete(p, std::align_val_t {Alignment});
+    }
+
+    friend auto operator==(const AlignedAllocator &, const AlignedAllocator &) noexcept -> bool
+    {
+        return true;
+    }
+};
+
+} // namespace mist
+
+#endif
@@ -0,0 +1,234 @@
+#include "CompressedMatrix.h"
+
+#include <array>
+#include <cstring>
+
+namespace mist
+{
+
+namespace
+{
+
+// lzCompress() format: a sequence is a token byte (high nibble: literal count, low nibble: match
+// length - minMatch), 255-continued extra bytes for nibbles of 15, the literals, a 2-byte
+// little-endian match offset, then extra match length bytes. The last sequence has literals only.
+constexpr std::size_t minMatch = 4;
+constexpr std::size_t maxOffset = 65535;
+constexpr int         hashBits = 12;
+
+auto read32(const std::uint8_t *p) -> std::uint32_t
+{
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+auto hash(std::uint32_t v) -> std::size_t
+{
+    return (v * 2654435761u) >> (32 - hashBits);
+}
+
+auto writeLength(std::vector<std::uint8_t> &out, std::size_t length) -> void
+{
+    for (; length >= 255; length -= 255)
+        out.push_back(255);
+    out.push_back(static_cast<std::uint8_t>(length));
+}
+
+auto writeSequence(std::vector<std::uint8_t> &out, std::span<const std::uint8_t> literals,
+                   std::size_t offset, std::size_t matchLength) -> void
+{
+    const auto literalNibble = std::min<std::size_t>(literals.size(), 15);
+    const auto matchNibble = matchLength ? std::min<std::size_t>(matchLength - minMatch, 15) : 0;
+    out.push_back(static_cast<std::uint8_t>(literalNibble << 4 | matchNibble));
+    if (literalNibble == 15) writeLength(out, literals.size() - 15);
+
+    out.insert(out.end(), literals.begin(), literals.end());
+    if (!matchLength) return;
+
+    out.push_back(static_cast<std::uint8_t>(offset));
+    out.push_back(static_cast<std::uint8_t>(offset >> 8));
+    if (matchNibble == 15) writeLength(out, matchLength - minMatch - 15);
+}
+
+auto writeVarint(std::vector<std::uint8_t> &out, std::uint64_t v) -> void
+{
+    for (; v >= 0x80; v >>= 7)
+        out.push_back(static_cast<std::uint8_t>(v | 0x80));
+    out.push_back(static_cast<std::uint8_t>(v));
+}
+
+[[noreturn]] auto corrupt() -> void
+{
+    throw std::runtime_error("Corrupt compressed data");
+}
+
+class Reader
+{
+public:
+    explicit Reader(std::span<const std::uint8_t> input_) : input(input_) {}
+
+    [[nodiscard]] auto done() const -> bool { return pos == input.size(); }
+    [[nodiscard]] auto rest() const -> std::span<const std::uint8_t> { return input.subspan(pos); }
+
+    auto byte() -> std::uint8_t
+    {
+        if (pos == input.size()) corrupt();
+        return input[pos++];
+    }
+
+    auto bytes(std::size_t count) -> std::span<const std::uint8_t>
+    {
+        if (count > input.size() - pos) corrupt();
+        pos += count;
+        return input.subspan(pos - count, count);
+    }
+
+    auto length(std::size_t nibble) -> std::size_t
+    {
+        if (nibble < 15) return nibble;
+        std::uint8_t b;
+        do {
+            b = byte();
+            nibble += b;
+        } while (b == 255);
+        return nibble;
+    }
+
+    auto varint() -> std::uint64_t
+    {
+        std::uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const auto b = byte();
+            v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        corrupt();
+    }
+
+private:
+    std::span<const std::uint8_t> input;
+    std::size_t                    pos {0};
+};
+
+// Prediction of value i from its left, upper and upper-left neighbors, a + b - c inside the block
+auto predict(std::span<const std::uint64_t> values, std::size_t i, std::size_t width)
+    -> std::uint64_t
+{
+    const auto x = i % width;
+    if (i >= width) {
+        if (x > 0) return values[i - 1] + values[i - width] - values[i - width - 1];
+        return values[i - width];
+    }
+    return x > 0 ? values[i - 1] : 0;
+}
+
+} // namespace
+
+auto lzCompress(std::span<const std::uint8_t> input) -> std::vector<std::uint8_t>
+{
+    std::vector<std::uint8_t> out;
+    out.reserve(input.size() / 2 + 16);
+
+    std::array<std::size_t, std::size_t {1} << hashBits> table {};
+    const auto                                          *data = input.data();
+
+    std::size_t literalStart = 0;
+    std::size_t pos = 0;
+    while (input.size() >= minMatch && pos <= input.size() - minMatch) {
+        const auto value = read32(data + pos);
+        auto      &slot = table[hash(value)];
+        const auto candidate = slot;
+        slot = pos + 1; // 0 = empty
+
+        if (candidate == 0 || pos - (candidate - 1) > maxOffset ||
+            read32(data + candidate - 1) != value) {
+            ++pos;
+            continue;
+        }
+
+        const auto matchStart = candidate - 1;
+        auto       length = minMatch;
+        while (pos + length < input.size() && data[matchStart + length] == data[pos + length])
+            ++length;
+
+        writeSequence(out, input.subspan(literalStart, pos - literalStart), pos - matchStart,
+                      length);
+        pos += length;
+        literalStart = pos;
+    }
+
+    writeSequence(out, input.subspan(literalStart), 0, 0);
+    return out;
+}
+
+auto lzDecompress(std::span<const std::uint8_t> input, std::size_t size)
+    -> std::vector<std::uint8_t>
+{
+    std::vector<std::uint8_t> out;
+    out.reserve(size);
+
+    Reader reader(input);
+    while (!reader.done()) {
+        const auto token = reader.byte();
+        const auto literals = reader.bytes(reader.length(token >> 4));
+        out.insert(out.end(), literals.begin(), literals.end());
+        if (reader.done()) break;
+
+        const std::size_t low = reader.byte();
+        const std::size_t offset = low | std::size_t {reader.byte()} << 8;
+        const auto        length = reader.length(token & 15u) + minMatch;
+        if (offset == 0 || offset > out.size() || length > size - std::min(size, out.size()))
+            corrupt();
+
+        // byte by byte, matches may overlap their own output
+        for (auto from = out.size() - offset, end = from + length; from < end; ++from)
+            out.push_back(out[from]);
+    }
+
+    if (out.size() != size) corrupt();
+    return out;
+}
+
+auto packChunk(std::span<const std::uint64_t> values, int width) -> std::vector<std::uint8_t>
+{
+    const auto w = static_cast<std::size_t>(width);
+
+    std::vector<std::uint8_t> residuals;
+    residuals.reserve(values.size() * 2);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        // zigzag, so small negative residuals are small too
+        const auto r = values[i] - predict(values, i, w);
+        writeVarint(residuals, r << 1 ^ (r >> 63 ? ~std::uint64_t {0} : 0));
+    }
+
+    // the residual size comes first, lzDecompress() needs it
+    std::vector<std::uint8_t> out;
+    writeVarint(out, residuals.size());
+
+    const auto compressed = lzCompress(residuals);
+    out.insert(out.end(), compressed.begin(), compressed.end());
+    return out;
+}
+
+auto unpackChunk(std::span<const std::uint8_t> packed, std::span<std::uint64_t> values, int width)
+    -> void
+{
+    const auto w = static_cast<std::size_t>(width);
+
+    Reader     header(packed);
+    const auto residualSize = header.varint();
+    if (residualSize > values.size() * 10) corrupt(); // varints are at most 10 bytes
+
+    const auto residuals = lzDecompress(header.rest(), residualSize);
+
+    Reader reader(residuals);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        const auto v = reader.varint();
+        const auto r = v >> 1 ^ (v & 1 ? ~std::uint64_t {0} : 0);
+        values[i] = predict(values, i, w) + r;
+    }
+    if (!reader.done()) corrupt();
+}
+
+} // namespace mist
@@ -0,0 +1,296 @@
+#ifndef COMPRESSEDMATRIX_H_
+#define COMPRESSEDMATRIX_H_
+
+#include "Matrix.h"
+#include "Parallel.h"
+#include "Point.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mist
+{
+
+// Byte codec in the spirit of LZ4: sequences of literal bytes and back-references of at least 4
+// bytes to the previous 64 KiB. Fast to decode, and good at the repetitive output of packChunk().
+[[nodiscard]] auto lzCompress(std::span<const std::uint8_t> input) -> std::vector<std::uint8_t>;
+
+// Decodes lzCompress() output of exactly 'size' bytes. Throws std::runtime_error on corrupt input.
+[[nodiscard]] auto lzDecompress(std::span<const std::uint8_t> input, std::size_t size)
+    -> std::vector<std::uint8_t>;
+
+// Packs a block of integers, 'width' values per row: each value is predicted from its left, upper
+// and upper-left neighbors (exact for planes), and the small residuals of smooth data are written
+// as variable-length integers and compressed with lzCompress(). Arithmetic wraps around, so any
+// 64-bit values round-trip.
+[[nodiscard]] auto packChunk(std::span<const std::uint64_t> values, int width)
+    -> std::vector<std::uint8_t>;
+
+// Restores the values.size() values packed by packChunk() with the same width
+auto unpackChunk(std::span<const std::uint8_t> packed, std::span<std::uint64_t> values, int width)
+    -> void;
+
+/* -------------------------------------------------------------------------- */
+
+// Read-mostly compressed copy of a matrix of numbers, for large maps that are mostly cold. The
+// matrix is split into square chunks of chunkSize, each compressed separately. A chunk is
+// decompressed on the first access to one of its values and then stays resident, so hot regions
+// are read at nearly Matrix speed; evict() compresses them again.
+//
+// Floating-point values are quantized to multiples of 'step', so they come back within step / 2.
+// Integers are stored exactly.
+//
+// Const access is thread-safe. Non-const access isn't, and marks the chunk modified: its values
+// are quantized and compressed again by the next evict().
+template <typename T> class CompressedMatrix
+{
+    static_assert(std::is_arithmetic_v<T>, "CompressedMatrix holds numbers");
+
+public:
+    using Size = Point2i;
+
+    static constexpr int defaultChunkSize = 64;
+
+    // chunkSize must be a power of two
+    template <class Layout, class Allocator>
+        requires std::floating_point<T>
+    CompressedMatrix(const Matrix<T, Layout, Allocator> &m, double step_,
+                     int chunkSize_ = defaultChunkSize, const ParallelPolicy &policy = {})
+        : CompressedMatrix(m.getSize(), step_, chunkSize_)
+    {
+        if (!(step > 0.0 && std::isfinite(step)))
+            throw std::invalid_argument("Quantization step must be positive");
+
+        compressAll(m, policy);
+    }
+
+    template <class Layout, class Allocator>
+        requires std::integral<T>
+    explicit CompressedMatrix(const Matrix<T, Layout, Allocator> &m,
+                              int chunkSize_ = defaultChunkSize, const ParallelPolicy &policy = {})
+        : CompressedMatrix(m.getSize(), 1.0, chunkSize_)
+    {
+        compressAll(m, policy);
+    }
+
+    [[nodiscard]] auto at(int x, int y) const -> const T & { return at(Point2i {x, y}); }
+    [[nodiscard]] auto at(const Point2i &p) const -> const T &
+    {
+        if (!contains(p)) throw std::out_of_range("CompressedMatrix::at");
+
+        const auto  i = chunkIndex(p);
+        const auto *values = chunks[i].values.load(std::memory_order_acquire);
+        if (!values) values = load(i);
+        return values[indexInChunk(p)];
+    }
+
+    [[nodiscard]] auto at(int x, int y) -> T & { return at(Point2i {x, y}); }
+    [[nodiscard]] auto at(const Point2i &p) -> T &
+    {
+        const auto &value = std::as_const(*this).at(p);
+        chunks[chunkIndex(p)].modified = true;
+        return const_cast<T &>(value);
+    }
+
+    [[nodiscard]] auto getXSize() const noexcept -> int { return xSize; }
+    [[nodiscard]] auto getYSize() const noexcept -> int { return ySize; }
+    [[nodiscard]] auto getSize() const noexcept -> Size { return Size {xSize, ySize}; }
+    [[nodiscard]] auto getChunkSize() const noexcept -> int { return chunkSize; }
+    [[nodiscard]] auto getStep() const noexcept -> double { return step; }
+
+    [[nodiscard]] auto contains(const Point2i &p) const -> bool
+    {
+        return p.x >= 0 && p.x < xSize && p.y >= 0 && p.y < ySize;
+    }
+
+    // Bytes of compressed data, not counting resident chunks
+    [[nodiscard]] auto compressedSize() const -> std::size_t
+    {
+        std::size_t size = 0;
+        for (const auto &c : chunks)
+            size += c.packed.size();
+        return size;
+    }
+
+    // Number of decompressed chunks
+    [[nodiscard]] auto residentChunks() const -> int
+    {
+        int count = 0;
+        for (const auto &c : chunks)
+            count += c.values.load(std::memory_order_relaxed) != nullptr;
+        return count;
+    }
+
+    // Compresses modified chunks again and releases all decompressed ones. Not thread-safe.
+    auto evict() -> void
+    {
+        std::vector<std::uint64_t> quantized;
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            auto &c = chunks[i];
+            if (c.modified) {
+                const auto area = chunkArea(i);
+                quantized.clear();
+                for (auto y = 0; y < area.y; ++y) {
+                    for (auto x = 0; x < area.x; ++x)
+                        quantized.push_back(quantize(c.storage[indexInChunk({x, y})]));
+                }
+                c.packed = packChunk(quantized, area.x);
+                c.modified = false;
+            }
+            c.values.store(nullptr, std::memory_order_relaxed);
+            c.storage.reset();
+        }
+    }
+
+    // Every value, decompressed into a new matrix
+    template <class Layout = RowMajorLayout, class Allocator = std::allocator<T>>
+    [[nodiscard]] auto decompress() const -> Matrix<T, Layout, Allocator>
+    {
+        Matrix<T, Layout, Allocator> m(getSize());
+        m.generate([&](const Point2i &p) {
+            return at(p);
+        });
+        return m;
+    }
+
+private:
+    struct Chunk {
+        std::vector<std::uint8_t> packed;
+        std::unique_ptr<T[]>      storage;
+        std::atomic<T *>          values {nullptr}; // storage, once it's filled
+        bool                      modified {false};
+    };
+
+    int                         xSize;
+    int                         ySize;
+    int                         chunkSize;
+    int                         chunkShift;
+    int                         xChunks;
+    double                      step;
+    mutable std::vector<Chunk>  chunks;
+    std::unique_ptr<std::mutex> loadMutex;
+
+    CompressedMatrix(const Size &size, double step_, int chunkSize_)
+        : xSize(size.x), ySize(size.y), chunkSize(chunkSize_), step(step_),
+          loadMutex(std::make_unique<std::mutex>())
+    {
+        if (chunkSize <= 0 || !std::has_single_bit(static_cast<unsigned>(chunkSize)))
+            throw std::invalid_argument("Chunk size must be a power of two");
+
+        chunkShift = std::countr_zero(static_cast<unsigned>(chunkSize));
+        xChunks = (xSize + chunkSize - 1) / chunkSize;
+        const auto yChunks = (ySize + chunkSize - 1) / chunkSize;
+        chunks = std::vector<Chunk>(static_cast<std::size_t>(xChunks * yChunks));
+    }
+
+    auto chunkIndex(const Point2i &p) const -> std::size_t
+    {
+        return static_cast<std::size_t>((p.y >> chunkShift) * xChunks + (p.x >> chunkShift));
+    }
+
+    // Resident chunks are stored row by row in chunkSize x chunkSize values, edge chunks included,
+    // so finding a value takes no division
+    auto indexInChunk(const Point2i &p) const -> std::size_t
+    {
+        const auto mask = chunkSize - 1;
+        return static_cast<std::size_t>((p.y & mask) << chunkShift | (p.x & mask));
+    }
+
+    auto chunkOrigin(std::size_t i) const -> Point2i
+    {
+        const auto index = static_cast<int>(i);
+        return {index % xChunks * chunkSize, index / xChunks * chunkSize};
+    }
+
+    // Size of chunk i, smaller than chunkSize at the right and bottom edges
+    auto chunkArea(std::size_t i) const -> Size
+    {
+        const auto origin = chunkOrigin(i);
+        return {std::min(chunkSize, xSize - origin.x), std::min(chunkSize, ySize - origin.y)};
+    }
+
+    auto quantize(T v) const -> std::uint64_t
+    {
+        if constexpr (std::is_floating_point_v<T>) {
+            const auto q = std::round(static_cast<double>(v) / step);
+            if (!(std::abs(q) < 0x1p62)) throw std::domain_error("Value can't be quantized");
+            return static_cast<std::uint64_t>(static_cast<std::int64_t>(q));
+        } else {
+            return static_cast<std::uint64_t>(v);
+        }
+    }
+
+    auto dequantize(std::uint64_t q) const -> T
+    {
+        if constexpr (std::is_floating_point_v<T>) {
+            return static_cast<T>(static_cast<double>(static_cast<std::int64_t>(q)) * step);
+        } else {
+            return static_cast<T>(q);
+        }
+    }
+
+    template <class Layout, class Allocator>
+    auto compressAll(const Matrix<T, Layout, Allocator> &m, const ParallelPolicy &policy) -> void
+    {
+        const auto numChunks = static_cast<int>(chunks.size());
+        const auto numWorkers = std::min(policy.threadCount > 0 ? policy.threadCount
+                                                                : hardwareThreadCount(),
+                                         std::max(1, numChunks));
+
+        std::vector<std::vector<std::uint64_t>> scratch(static_cast<std::size_t>(numWorkers));
+        parallelFor(numChunks, numWorkers, [&](int i, int worker) {
+            const auto index = static_cast<std::size_t>(i);
+            const auto origin = chunkOrigin(index);
+            const auto area = chunkArea(index);
+
+            auto &quantized = scratch[static_cast<std::size_t>(worker)];
+            quantized.clear();
+            for (auto y = origin.y; y < origin.y + area.y; ++y) {
+                for (auto x = origin.x; x < origin.x + area.x; ++x)
+                    quantized.push_back(quantize(m[{x, y}]));
+            }
+            chunks[index].packed = packChunk(quantized, area.x);
+        });
+    }
+
+    // Decompresses chunk i, unless another thread got there first
+    auto load(std::size_t i) const -> const T *
+    {
+        auto &c = chunks[i];
+
+        const std::lock_guard lock(*loadMutex);
+        if (const auto *values = c.values.load(std::memory_order_acquire)) return values;
+
+        const auto area = chunkArea(i);
+
+        std::vector<std::uint64_t> quantized(static_cast<std::size_t>(area.x * area.y));
+        unpackChunk(c.packed, quantized, area.x);
+
+        c.storage = std::make_unique_for_overwrite<T[]>(static_cast<std::size_t>(chunkSize) *
+                                                         static_cast<std::size_t>(chunkSize));
+        auto q = quantized.begin();
+        for (auto y = 0; y < area.y; ++y) {
+            for (auto x = 0; x < area.x; ++x)
+                c.storage[indexInChunk({x, y})] = dequantize(*q++);
+        }
+
+        c.values.store(c.storage.get(), std::memory_order_release);
+        return c.storage.get();
+    }
+};
+
+} // namespace mist
+
+#endif
@@ -0,0 +1,308 @@
+#ifndef COWMATRIX_H_
+#define COWMATRIX_H_
+
+#include "Matrix.h"
+#include "MatrixLayout.h"
+#include "Point.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace mist
+{
+
+template <typename T, int TileSize> class CowMatrix;
+
+// Immutable state of a CowMatrix at the time of CowMatrix::snapshot(). Snapshots have the read
+// interface of Matrix, so generic algorithms and MapTools run on them, and any number of threads
+// can read them without locking while the matrix changes. Copies are cheap, and share all values.
+//
+// Values are stored in square tiles of TileSize, like in TiledLayout, each with the revision of its
+// last modification (see foreachModifiedTile()).
+template <typename T, int TileSize = 64> class MatrixSnapshot
+{
+    static_assert(TileSize > 0 && (TileSize & (TileSize - 1)) == 0);
+
+public:
+    using Size = Point2i;
+    using value_type = T;
+    using layout_type = TiledLayout<TileSize>;
+
+    // Empty snapshot
+    MatrixSnapshot() : MatrixSnapshot(Size {0, 0}) {}
+
+    [[nodiscard]] auto at(int x, int y) const -> const T & { return at(Point2i {x, y}); }
+    [[nodiscard]] auto at(const Point2i &p) const -> const T &
+    {
+        if (!contains(p)) throw std::out_of_range("MatrixSnapshot::at");
+        return (*this)[p];
+    }
+
+    // Unchecked access, like Matrix::operator[]
+    [[nodiscard]] auto operator[](const Point2i &p) const -> const T &
+    {
+        assert(contains(p));
+        return (*tiles)[tileIndex(p.x / TileSize, p.y / TileSize)]->values[indexInTile(p)];
+    }
+
+    [[nodiscard]] auto getXSize() const noexcept -> int { return xSize; }
+    [[nodiscard]] auto getYSize() const noexcept -> int { return ySize; }
+    [[nodiscard]] auto getSize() const noexcept -> Size { return Size {xSize, ySize}; }
+    [[nodiscard]] auto getRevision() const noexcept -> std::uint64_t { return revision; }
+    [[nodiscard]] auto getModifiedTileSize() const noexcept -> int { return TileSize; }
+
+    [[nodiscard]] auto contains(const Point2i &p) const -> bool
+    {
+        return p.x >= 0 && p.x < xSize && p.y >= 0 && p.y < ySize;
+    }
+
+    // Calls func(origin, size) for each tile modified after revision 'since', clipped to the
+    // matrix, like Matrix::foreachModifiedTile()
+    template <typename F> auto foreachModifiedTile(std::uint64_t since, F func) const -> void
+    {
+        forEachTile([&](std::size_t i, const Point2i &origin, const Size &size) {
+            if ((*tiles)[i]->revision > since) func(origin, size);
+        });
+    }
+
+    template <typename F> auto foreachKey(F func) const -> const MatrixSnapshot &
+    {
+        for (auto y = 0; y < ySize; ++y) {
+            for (auto x = 0; x < xSize; ++x) {
+                func(Point2i {x, y});
+            }
+        }
+
+        return *this;
+    }
+
+    template <typename F> auto foreachValue(F func) const -> const MatrixSnapshot &
+    {
+        forEachRowPart([&](int, int, const T *values, int count) {
+            for (auto i = 0; i < count; ++i)
+                func(values[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F> auto foreachKeyValue(F func) const -> const MatrixSnapshot &
+    {
+        forEachRowPart([&](int x0, int y, const T *values, int count) {
+            for (auto i = 0; i < count; ++i)
+                func(Point2i {x0 + i, y}, values[i]);
+        });
+
+        return *this;
+    }
+
+private:
+    friend class CowMatrix<T, TileSize>;
+
+    static constexpr std::size_t tileArea = static_cast<std::size_t>(TileSize) * TileSize;
+
+    struct Tile {
+        std::uint64_t           revision {0};
+        std::array<T, tileArea> values {};
+    };
+    using Tiles = std::vector<std::shared_ptr<Tile>>;
+
+    int                    xSize;
+    int                    ySize;
+    int                    xTiles;
+    std::uint64_t          revision {0};
+    std::shared_ptr<Tiles> tiles; // row by row, never modified while shared
+
+    explicit MatrixSnapshot(const Size &size)
+        : xSize(size.x), ySize(size.y), xTiles((size.x + TileSize - 1) / TileSize),
+          tiles(std::make_shared<Tiles>())
+    {
+        if (size.x < 0 || size.y < 0) throw std::invalid_argument("Negative matrix size");
+
+        const auto yTiles = (ySize + TileSize - 1) / TileSize;
+        tiles->resize(static_cast<std::size_t>(xTiles * yTiles));
+        for (auto &tile : *tiles)
+            tile = std::make_shared<Tile>();
+    }
+
+    auto tileIndex(int tx, int ty) const -> std::size_t
+    {
+        return static_cast<std::size_t>(ty * xTiles + tx);
+    }
+
+    static auto indexInTile(const Point2i &p) -> std::size_t
+    {
+        return static_cast<std::size_t>(p.y % TileSize * TileSize + p.x % TileSize);
+    }
+
+    // Calls func(x, y, values, count) for the parts of each row in a tile, in row-major order, so
+    // the tile is only looked up once per part
+    template <typename F> auto forEachRowPart(F func) const -> void
+    {
+        for (auto y = 0; y < ySize; ++y) {
+            const auto rowInTile = static_cast<std::size_t>(y % TileSize * TileSize);
+
+            for (auto tx = 0; tx < xTiles; ++tx) {
+                const auto &tile = *(*tiles)[tileIndex(tx, y / TileSize)];
+                func(tx * TileSize, y, tile.values.data() + rowInTile,
+                     std::min(TileSize, xSize - tx * TileSize));
+            }
+        }
+    }
+
+    // Calls func(index, origin, size) for each tile, clipped to the matrix
+    template <typename F> auto forEachTile(F func) const -> void
+    {
+        for (auto ty = 0; ty * TileSize < ySize; ++ty) {
+            for (auto tx = 0; tx < xTiles; ++tx) {
+                const Point2i origin {tx * TileSize, ty * TileSize};
+                const Size    size {std::min(TileSize, xSize - origin.x),
+                                 std::min(TileSize, ySize - origin.y)};
+                func(tileIndex(tx, ty), origin, size);
+            }
+        }
+    }
+};
+
+/* -------------------------------------------------------------------------- */
+
+// Matrix with O(1) snapshots, for maps modified by one thread and read by others. Values are stored
+// in tiles shared with snapshots and copies of the matrix: snapshot() only shares the tiles, and a
+// write copies its tile first if a snapshot still uses it, so editing a few points of a large map
+// copies a few tiles. Tiles no snapshot uses are written in place.
+//
+// A CowMatrix isn't thread-safe, but its snapshots can be read on any thread while it changes.
+// Every write is tracked (see foreachModifiedTile()); there are no untracked writes like
+// Matrix::operator[].
+template <typename T, int TileSize = 64> class CowMatrix : private MatrixSnapshot<T, TileSize>
+{
+    using Base = MatrixSnapshot<T, TileSize>;
+    using Tile = typename Base::Tile;
+
+public:
+    using Size = Point2i;
+    using value_type = T;
+    using layout_type = TiledLayout<TileSize>;
+
+    CowMatrix(int xSize_, int ySize_) : Base(Size {xSize_, ySize_}) {}
+    explicit CowMatrix(const Size &size) : Base(size) {}
+
+    template <class Layout, class Allocator>
+    explicit CowMatrix(const Matrix<T, Layout, Allocator> &m) : Base(m.getSize())
+    {
+        generate([&](const Point2i &p) {
+            return m[p];
+        });
+    }
+
+    using Base::at;
+    using Base::contains;
+    using Base::foreachKey;
+    using Base::foreachKeyValue;
+    using Base::foreachModifiedTile;
+    using Base::foreachValue;
+    using Base::getModifiedTileSize;
+    using Base::getRevision;
+    using Base::getSize;
+    using Base::getXSize;
+    using Base::getYSize;
+    using Base::operator[];
+
+    [[nodiscard]] auto at(int x, int y) -> T & { return at(Point2i {x, y}); }
+    [[nodiscard]] auto at(const Point2i &p) -> T &
+    {
+        if (!contains(p)) throw std::out_of_range("CowMatrix::at");
+
+        auto &tile = writableTile(this->tileIndex(p.x / TileSize, p.y / TileSize), false);
+        tile.revision = ++this->revision;
+        return tile.values[Base::indexInTile(p)];
+    }
+
+    // The current values, which no later write changes
+    [[nodiscard]] auto snapshot() const -> MatrixSnapshot<T, TileSize>
+    {
+        return static_cast<const Base &>(*this);
+    }
+
+    auto fill(const T &value) -> CowMatrix &
+    {
+        ++this->revision;
+        this->forEachTile([&](std::size_t i, const Point2i &, const Size &) {
+            auto &tile = writableTile(i, true);
+            tile.revision = this->revision;
+            tile.values.fill(value);
+        });
+
+        return *this;
+    }
+
+    template <class G> auto generate(G generator) -> CowMatrix &
+    {
+        forEachWritable(true, [&](const Point2i &p, T &v) {
+            v = generator(p);
+        });
+
+        return *this;
+    }
+
+    template <typename F> auto transform(F func) -> CowMatrix &
+    {
+        forEachWritable(false, [&](const Point2i &, T &v) {
+            v = func(v);
+        });
+
+        return *this;
+    }
+
+private:
+    // Tile i, copied first if a snapshot or copy shares it. 'overwrite' skips copying values
+    // that are all about to be replaced.
+    auto writableTile(std::size_t i, bool overwrite) -> Tile &
+    {
+        auto &table = this->tiles;
+        if (table.use_count() > 1) table = std::make_shared<typename Base::Tiles>(*table);
+
+        auto      &tile = (*table)[i];
+        const auto shared = tile.use_count() > 1;
+
+        // the last snapshot sharing the table or the tile may have been released on another
+        // thread, and its reads must happen before our writes
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (shared) tile = overwrite ? std::make_shared<Tile>() : std::make_shared<Tile>(*tile);
+        return *tile;
+    }
+
+    // Calls func(p, value) for every point, tile by tile, with writable values
+    template <typename F> auto forEachWritable(bool overwrite, F func) -> void
+    {
+        ++this->revision;
+        this->forEachTile([&](std::size_t i, const Point2i &origin, const Size &size) {
+            auto &tile = writableTile(i, overwrite);
+            tile.revision = this->revision;
+
+            for (auto y = 0; y < size.y; ++y) {
+                for (auto x = 0; x < size.x; ++x)
+                    func(origin + Point2i {x, y}, tile.values[Base::indexInTile({x, y})]);
+            }
+        });
+    }
+};
+
+template <typename T, int TileSize>
+CachedStatistics(const MatrixSnapshot<T, TileSize> &)
+    -> CachedStatistics<T, TiledLayout<TileSize>, MatrixSnapshot<T, TileSize>>;
+template <typename T, int TileSize>
+CachedStatistics(const MatrixSnapshot<T, TileSize> &, const HistogramBins &)
+    -> CachedStatistics<T, TiledLayout<TileSize>, MatrixSnapshot<T, TileSize>>;
+
+} // namespace mist
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef FLOWFIELD_H_
+#define FLOWFIELD_H_
+
+#include "CowMatrix.h"
+#include "MapTools.h"
+#include "Matrix.h"
+#include "Point.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace mist
+{
+
+// Cheapest routes from every point of a map to the nearest of a set of goals, for many units
+// heading to the same goals. Each point holds the cost of its route (the integration field) and the
+// neighbor to step to, so a unit anywhere finds its next step in O(1), and following next() leads
+// to a goal along a cheapest route. Costs are those of routes to the goals in AStar (see
+// StepCosts): routes may leave a blocked point, but never enter one.
+//
+// update() follows moving goals and changes to the map. Only the costs of points whose route led
+// to a goal that is gone, or crossed a modified tile of the map (see Matrix::trackModifiedTiles()),
+// are calculated again, then improved from the new goals, so moving a few goals a short distance
+// leaves the routes to the others as they are.
+//
+// The field is as large as the map, read through Map as in StepCosts, so a matrix must keep its
+// size while a FlowField reads it, but may be assigned to between updates (see AStar).
+template <typename T, class Layout = RowMajorLayout, class Map = MatrixView<const T, Layout>>
+class FlowField
+{
+private:
+    static constexpr auto infinity = std::numeric_limits<T>::max();
+
+public:
+    template <class Allocator>
+    explicit FlowField(const Matrix<T, Layout, Allocator> &map) : FlowField(MatrixSource<Map>(map))
+    {
+    }
+
+    explicit FlowField(MatrixSource<Map> map)
+        : steps(map), costs(area(), infinity), directions(area(), none)
+    {
+    }
+
+    // Costs and directions towards the nearest of 'goals'. Throws std::out_of_range if a goal is
+    // outside the map.
+    auto calculate(const std::vector<Point2i> &goals_) -> FlowField &
+    {
+        setNextGoals(goals_);
+        steps.update();
+        goals.swap(nextGoals);
+        calculateAll();
+
+        calculated = true;
+        ++results;
+        return *this;
+    }
+
+    // Brings the costs and directions of the last calculate() up to date with 'goals_' and with the
+    // changes to the map since. Everything is calculated again if the changes move the map
+    // minimum, which offsets every step, or the settings changed.
+    auto update(const std::vector<Point2i> &goals_) -> FlowField &
+    {
+        if (!calculated) throw std::logic_error("FlowField::update() before calculate()");
+
+        setNextGoals(goals_);
+        expansions = 0;
+        forgotten.clear();
+
+        // Forget the costs of modified points, and of goals that are gone...
+        const auto all = steps.update([&](const Point2i &origin, const Point2i &size) {
+            for (auto y = origin.y; y < origin.y + size.y; ++y) {
+                for (auto x = origin.x; x < origin.x + size.x; ++x)
+                    forget(indexOf({x, y}));
+            }
+        });
+        if (all) {
+            goals.swap(nextGoals);
+            calculateAll();
+            ++results;
+            return *this;
+        }
+
+        for (const auto g : goals) {
+            if (costs[index(g)] < infinity &&
+                !std::binary_search(nextGoals.begin(), nextGoals.end(), g))
+                forget(g);
+        }
+
+        // ...and of the points whose routes led through them
+        for (std::size_t k = 0; k < forgotten.size(); ++k) {
+            const auto i = forgotten[k];
+            forEachNeighbor(steps.getSize(), i, false, [&](int j, int d) {
+                if (costs[index(j)] < infinity && directions[index(j)] == opposite(d)) forget(j);
+            });
+        }
+
+        // Routes to the forgotten points come from their neighbors with known costs, or from the
+        // new goals. Past half the map, starting from the goals alone is faster.
+        if (forgotten.size() > area() / 2) {
+            goals.swap(nextGoals);
+            calculateAll();
+            ++results;
+            return *this;
+        }
+        heap.clear();
+        for (const auto i : forgotten) {
+            forEachNeighbor(steps.getSize(), i, false, [&](int j, int) {
+                if (costs[index(j)] < infinity) heap.push(costs[index(j)], costs[index(j)], j);
+            });
+        }
+        goals.swap(nextGoals);
+        for (const auto g : goals) {
+            if (costs[index(g)] != 0) seed(g);
+        }
+
+        explore();
+
+        ++results;
+        return *this;
+    }
+
+    auto update() -> FlowField &
+    {
+        nextGoalPoints.clear();
+        for (const auto g : goals)
+            nextGoalPoints.push_back(pointOf(g));
+        return update(nextGoalPoints);
+    }
+
+    [[nodiscard]] auto canReach(const Point2i &p) const -> bool
+    {
+        if (!steps.getMap().contains(p)) throw std::out_of_range("FlowField::canReach");
+        return costs[index(indexOf(p))] < infinity;
+    }
+
+    // Neighbor of 'p' to step to on a cheapest route to a goal, or 'p' itself at a goal and where
+    // no goal can be reached
+    [[nodiscard]] auto next(const Point2i &p) const -> Point2i
+    {
+        if (!steps.getMap().contains(p)) throw std::out_of_range("FlowField::next");
+        const auto d = directions[index(indexOf(p))];
+        return d == none ? p : p + neighborOffsets[d];
+    }
+
+    // Costs of the routes to the nearest goal, infinity where no goal can be reached
+    [[nodiscard]] auto getCost() const -> const Matrix<T, Layout> &
+    {
+        return cost.get(
+            results,
+            [&] {
+                return Matrix<T, Layout>(steps.getSize());
+            },
+            [&](Matrix<T, Layout> &m) {
+                m.generate([&](const Point2i &p) {
+                    return costs[index(indexOf(p))];
+                });
+            });
+    }
+
+    // Steps of next(), next(p) - p for every point p
+    [[nodiscard]] auto getDirections() const -> const Matrix<Point2i, Layout> &
+    {
+        return direction.get(
+            results,
+            [&] {
+                return Matrix<Point2i, Layout>(steps.getSize());
+            },
+            [&](Matrix<Point2i, Layout> &m) {
+                m.generate([&](const Point2i &p) {
+                    const auto d = directions[index(indexOf(p))];
+                    return d == none ? Point2i {0, 0} : neighborOffsets[d];
+                });
+            });
+    }
+
+    auto setStepCostFactor(T a) -> FlowField &
+    {
+        steps.setFactor(a);
+        return *this;
+    }
+
+    auto setBlockValue(T blockValue_) -> FlowField &
+    {
+        steps.setBlockValue(blockValue_);
+        return *this;
+    }
+
+    // Points expanded by the last calculation or update
+    [[nodiscard]] auto getExpansions() const noexcept -> std::size_t { return expansions; }
+
+private:
+    static constexpr std::uint8_t none = neighborOffsets.size();
+
+    StepCosts<T, Layout, Map> steps;
+
+    // By flat index y * xSize + x. 'directions' index neighborOffsets, towards the next point.
+    std::vector<T>            costs;
+    std::vector<std::uint8_t> directions;
+    std::vector<int>          goals; // sorted indices
+    bool                      calculated {false};
+    RouteQueue<T>             heap; // keyed by cost
+    std::size_t               expansions {0};
+
+    // Scratch space of update(), which reuses it between calls
+    std::vector<int>     nextGoals;
+    std::vector<Point2i> nextGoalPoints;
+    std::vector<int>     forgotten;
+
+    // Costs and directions as matrices, filled by the first getCost() or getDirections() after a
+    // calculation or update, which may come from several threads at once
+    LazyMatrix<Matrix<T, Layout>>       cost;
+    LazyMatrix<Matrix<Point2i, Layout>> direction;
+    std::uint64_t                       results {0};
+
+    auto area() const -> std::size_t
+    {
+        const auto size = steps.getSize();
+        return static_cast<std::size_t>(size.x) * static_cast<std::size_t>(size.y);
+    }
+
+    auto indexOf(const Point2i &p) const -> int { return p.y * steps.getSize().x + p.x; }
+    auto pointOf(int i) const -> Point2i { return {i % steps.getSize().x, i / steps.getSize().x}; }
+    static auto index(int i) -> std::size_t { return static_cast<std::size_t>(i); }
+    static auto opposite(int d) -> std::uint8_t { return static_cast<std::uint8_t>((d + 2) % 4); }
+
+    // Sorts the indices of 'goals_' into 'nextGoals'
+    auto setNextGoals(const std::vector<Point2i> &goals_) -> void
+    {
+        nextGoals.clear();
+        for (const auto &g : goals_) {
+            if (!steps.getMap().contains(g))
+                throw std::out_of_range("FlowField: goal outside the map");
+            nextGoals.push_back(indexOf(g));
+        }
+        std::sort(nextGoals.begin(), nextGoals.end());
+        nextGoals.erase(std::unique(nextGoals.begin(), nextGoals.end()), nextGoals.end());
+    }
+
+    // Unknown costs are forgotten too where the map changed, as they may become known
+    auto forget(int i) -> void
+    {
+        costs[index(i)] = infinity;
+        directions[index(i)] = none;
+        forgotten.push_back(i);
+    }
+
+    auto seed(int goal) -> void
+    {
+        costs[index(goal)] = 0;
+        directions[index(goal)] = none;
+        heap.push(0, 0, goal);
+    }
+
+    auto calculateAll() -> void
+    {
+        std::fill(costs.begin(), costs.end(), infinity);
+        std::fill(directions.begin(), directions.end(), none);
+        expansions = 0;
+
+        heap.clear();
+        for (const auto g : goals)
+            seed(g);
+
+        explore();
+    }
+
+    // Dijkstra's algorithm outwards from the points in the heap. A route from a neighbor j of
+    // point i costs the step into i more than the route from i.
+    auto explore() -> void
+    {
+        while (!heap.empty()) {
+            const auto [key, c, i] = heap.pop();
+            if (c > costs[index(i)]) continue;
+
+            const auto step = steps[index(i)];
+            if (step == StepCosts<T, Layout, Map>::blocked) continue;
+            ++expansions;
+
+            const auto candidateCost = static_cast<T>(c + step);
+            forEachNeighbor(steps.getSize(), i, false, [&](int j, int d) {
+                if (candidateCost < costs[index(j)]) {
+                    costs[index(j)] = candidateCost;
+                    directions[index(j)] = opposite(d);
+                    heap.push(candidateCost, candidateCost, j);
+                }
+            });
+        }
+    }
+};
+
+template <typename T, class Layout>
+FlowField(MatrixView<T, Layout>) -> FlowField<std::remove_const_t<T>, Layout>;
+
+template <typename T, int TileSize>
+FlowField(const MatrixSnapshot<T, TileSize> &)
+    -> FlowField<T, TiledLayout<TileSize>, MatrixSnapshot<T, TileSize>>;
+
+} // namespace mist
+
+#endif
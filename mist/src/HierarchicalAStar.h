@@ -0,0 +1,512 @@
+#ifndef HIERARCHICALASTAR_H_
+#define HIERARCHICALASTAR_H_
+
+#include "CowMatrix.h"
+#include "MapTools.h"
+#include "Matrix.h"
+#include "Point.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mist
+{
+
+// Routes between two points of a map, found over a graph of clusters (HPA*) instead of over every
+// point. The map is split into square clusters. Where a run of points along the border of two
+// clusters can be crossed, one or two of its pairs of points become entrances, and the costs of
+// the cheapest routes between the entrances of each cluster, inside it, are computed in advance. A
+// route is searched on this graph, then point by point inside each cluster it crosses. Routes are
+// found whenever one exists, and cost close to, but not always exactly, the cheapest.
+//
+// Steps cost like in AStar (see StepCosts). update() builds the graph again only for the clusters
+// around the modified tiles of the map (see Matrix::trackModifiedTiles()), unless the settings or
+// the map minimum changed.
+//
+// The map is read through Map, as in StepCosts, so a matrix must outlive the HierarchicalAStar
+// and keep its size, but may be assigned to between updates (see AStar).
+template <typename T, class Layout = RowMajorLayout, class Map = MatrixView<const T, Layout>>
+class HierarchicalAStar
+{
+private:
+    static constexpr auto infinity = std::numeric_limits<T>::max();
+
+public:
+    template <class Allocator>
+    explicit HierarchicalAStar(const Matrix<T, Layout, Allocator> &map, int clusterSize_ = 16)
+        : HierarchicalAStar(MatrixSource<Map>(map), clusterSize_)
+    {
+    }
+
+    explicit HierarchicalAStar(MatrixSource<Map> map, int clusterSize_ = 16)
+        : steps(map), clusterSize(checkClusterSize(clusterSize_)),
+          xClusters(clustersFor(steps.getSize().x)), yClusters(clustersFor(steps.getSize().y))
+    {
+        clusters.resize(static_cast<std::size_t>(xClusters * yClusters));
+        dirty.assign(clusters.size(), true);
+    }
+
+    // Builds the graph again for the clusters where the map or the settings changed since the
+    // last update(). route() calls it first.
+    auto update() -> HierarchicalAStar &
+    {
+        // changes move the entrances of the clusters they border too
+        const auto all = steps.update([&](const Point2i &origin, const Point2i &size) {
+            const auto first = clusterOf(max(origin - Point2i {1, 1}, Point2i {0, 0}));
+            const auto last = clusterOf(min(origin + size, steps.getSize() - Point2i {1, 1}));
+            for (auto cy = first.y; cy <= last.y; ++cy) {
+                for (auto cx = first.x; cx <= last.x; ++cx)
+                    dirty[clusterIndex({cx, cy})] = true;
+            }
+        });
+        if (all) std::fill(dirty.begin(), dirty.end(), true);
+
+        if (std::find(dirty.begin(), dirty.end(), true) == dirty.end()) return *this;
+
+        for (std::size_t c = 0; c < clusters.size(); ++c) {
+            if (dirty[c]) build(static_cast<int>(c));
+        }
+        std::fill(dirty.begin(), dirty.end(), false);
+        numberNodes();
+
+        return *this;
+    }
+
+    // Route from 'from' to 'to', both included, or an empty route if 'to' can't be reached
+    [[nodiscard]] auto route(const Point2i &from, const Point2i &to) -> std::vector<Point2i>
+    {
+        const auto &map = steps.getMap();
+        if (!map.contains(from) || !map.contains(to))
+            throw std::out_of_range("HierarchicalAStar::route: point outside the map");
+
+        update();
+        if (from == to) return {from};
+        if (steps[to] == StepCosts<T, Layout, Map>::blocked) return {};
+
+        const auto startCluster = clusterIndex(clusterOf(from));
+        const auto goalCluster = clusterIndex(clusterOf(to));
+
+        // routes inside a cluster don't need the graph
+        std::vector<Point2i> ret {from};
+        if (startCluster == goalCluster && searchCluster(startCluster, from, false, to)) {
+            appendLocalRoute(ret, to);
+            return ret;
+        }
+
+        // Routes leave from 'from' in its cluster. Routes may leave a blocked point, but not
+        // through an entrance, so they may also leave to its neighbors in other clusters.
+        seeds.assign(1, {from, startCluster, 0});
+        if (blocked(from)) {
+            for (const auto &d : directions) {
+                const auto q = from + d;
+                if (!map.contains(q) || blocked(q)) continue;
+
+                const auto c = clusterIndex(clusterOf(q));
+                if (c != startCluster) seeds.push_back({q, c, steps[q]});
+            }
+        }
+
+        if (!searchGraph(to, goalCluster)) return {};
+
+        // entrances on the route, from the start, and the seed it started from
+        std::vector<int> nodes;
+        auto             n = nodeParents[goalNode()];
+        for (; n >= 0; n = nodeParents[index(n)])
+            nodes.push_back(n);
+        std::reverse(nodes.begin(), nodes.end());
+
+        const auto &seed = seeds[index(-1 - n)];
+        if (seed.point != from) ret.push_back(seed.point);
+        searchCluster(seed.cluster, seed.point, false, entrance(nodes.front()).point);
+        appendLocalRoute(ret, entrance(nodes.front()).point);
+        for (std::size_t i = 1; i < nodes.size(); ++i) {
+            const auto &a = entrance(nodes[i - 1]);
+            const auto &b = entrance(nodes[i]);
+            const auto  cluster = nodeClusters[index(nodes[i])];
+
+            if (nodeClusters[index(nodes[i - 1])] != cluster) {
+                ret.push_back(b.point);
+            } else {
+                searchCluster(index(cluster), a.point, false, b.point);
+                appendLocalRoute(ret, b.point);
+            }
+        }
+        searchCluster(goalCluster, entrance(nodes.back()).point, false, to);
+        appendLocalRoute(ret, to);
+
+        return ret;
+    }
+
+    [[nodiscard]] auto getClusterSize() const noexcept -> int { return clusterSize; }
+
+    auto setStepCostFactor(T a) -> HierarchicalAStar &
+    {
+        steps.setFactor(a);
+        return *this;
+    }
+
+    auto setBlockValue(T blockValue_) -> HierarchicalAStar &
+    {
+        steps.setBlockValue(blockValue_);
+        return *this;
+    }
+
+private:
+    static constexpr std::array directions {Point2i {-1, 0}, Point2i {0, -1}, Point2i {1, 0},
+                                            Point2i {0, 1}};
+
+    // Runs of crossable points along a border at least this long get an entrance at each end,
+    // shorter ones one in the middle
+    static constexpr int longRun = 6;
+
+    // Point on the border of a cluster, with a bit for each of 'directions' in which it leads into
+    // a neighboring cluster
+    struct Entrance {
+        Point2i      point;
+        unsigned int exits;
+    };
+
+    struct Cluster {
+        std::vector<Entrance> entrances;
+        std::vector<T>        costs; // from entrance i to entrance j at i * entrances + j
+    };
+
+    StepCosts<T, Layout, Map> steps;
+    int                       clusterSize;
+    int                       xClusters;
+    int                       yClusters;
+    std::vector<Cluster>      clusters;
+    std::vector<bool>         dirty;
+
+    // Graph nodes are the entrances of all clusters, numbered cluster by cluster, and the goal
+    std::vector<int> firstNodes; // by cluster
+    std::vector<int> nodeClusters;
+    std::vector<T>   goalCosts; // from the entrances of the goal cluster
+
+    // Points where routes from the start enter the graph search, at 'cost' from the start
+    struct Seed {
+        Point2i     point;
+        std::size_t cluster;
+        T           cost;
+    };
+    std::vector<Seed> seeds;
+
+    // Costs and parents of the last graph search, valid where 'nodeSearches' is the current search
+    std::vector<T>             nodeCosts;
+    std::vector<int>           nodeParents;
+    std::vector<std::uint32_t> nodeSearches;
+    std::uint32_t              currentSearch {0};
+    RouteQueue<T>              nodeQueue;
+
+    // Costs and parents of the last search inside a cluster, by y * size.x + x relative to origin
+    Point2i          localOrigin;
+    Point2i          localSize;
+    std::vector<T>   localCosts;
+    std::vector<int> localParents;
+    RouteQueue<T>    localQueue;
+
+    // Before the cluster counts divide by it
+    static auto checkClusterSize(int size) -> int
+    {
+        if (size < 2) throw std::invalid_argument("HierarchicalAStar: cluster size below 2");
+        return size;
+    }
+
+    auto clustersFor(int size) const -> int { return (size + clusterSize - 1) / clusterSize; }
+
+    auto clusterOf(const Point2i &p) const -> Point2i { return p / clusterSize; }
+
+    auto clusterIndex(const Point2i &c) const -> std::size_t
+    {
+        return static_cast<std::size_t>(c.y * xClusters + c.x);
+    }
+
+    auto clusterPosition(std::size_t c) const -> Point2i
+    {
+        return {static_cast<int>(c) % xClusters, static_cast<int>(c) / xClusters};
+    }
+
+    static auto index(int i) -> std::size_t { return static_cast<std::size_t>(i); }
+
+    static auto max(const Point2i &a, const Point2i &b) -> Point2i
+    {
+        return {std::max(a.x, b.x), std::max(a.y, b.y)};
+    }
+
+    static auto min(const Point2i &a, const Point2i &b) -> Point2i
+    {
+        return {std::min(a.x, b.x), std::min(a.y, b.y)};
+    }
+
+    // Origin and size of cluster c, clipped to the map
+    auto clusterRect(std::size_t c) const -> std::pair<Point2i, Point2i>
+    {
+        const auto origin = clusterPosition(c) * clusterSize;
+        return {origin, min(Point2i {clusterSize, clusterSize}, steps.getSize() - origin)};
+    }
+
+    auto entrance(int node) const -> const Entrance &
+    {
+        const auto c = index(nodeClusters[index(node)]);
+        return clusters[c].entrances[index(node - firstNodes[c])];
+    }
+
+    auto goalNode() const -> std::size_t { return nodeClusters.size(); }
+
+    auto blocked(const Point2i &p) const -> bool
+    {
+        return steps[p] == StepCosts<T, Layout, Map>::blocked;
+    }
+
+    auto heuristic(const Point2i &p, const Point2i &to) const -> T
+    {
+        if (!(steps.getMin() < infinity)) return 0;
+        return steps.getMin() * static_cast<T>(std::abs(p.x - to.x) + std::abs(p.y - to.y));
+    }
+
+    // Finds the entrances of cluster c and the costs between them
+    auto build(int c) -> void
+    {
+        const auto [origin, size] = clusterRect(index(c));
+        auto &entrances = clusters[index(c)].entrances;
+        entrances.clear();
+
+        const auto addEntrance = [&](const Point2i &p, unsigned int exit) {
+            const auto found = std::find_if(entrances.begin(), entrances.end(),
+                                            [&](const Entrance &e) { return e.point == p; });
+            if (found != entrances.end())
+                found->exits |= exit;
+            else
+                entrances.push_back({p, exit});
+        };
+
+        // Points along each border, in the same order from both clusters so they pick the same
+        // pairs. Borders at the edge of the map have no pairs.
+        for (std::size_t d = 0; d < directions.size(); ++d) {
+            const auto dir = directions[d];
+            const auto along = dir.x != 0 ? Point2i {0, 1} : Point2i {1, 0};
+            const auto first =
+                origin + Point2i {dir.x > 0 ? size.x - 1 : 0, dir.y > 0 ? size.y - 1 : 0};
+            const auto length = dir.x != 0 ? size.y : size.x;
+            if (!steps.getMap().contains(first + dir)) continue;
+
+            const auto open = [&](int k) {
+                const auto p = first + along * k;
+                return !blocked(p) && !blocked(p + dir);
+            };
+
+            for (auto k = 0; k < length;) {
+                if (!open(k)) {
+                    ++k;
+                    continue;
+                }
+
+                auto end = k;
+                while (end + 1 < length && open(end + 1))
+                    ++end;
+
+                const auto exit = 1U << d;
+                if (end - k + 1 < longRun) {
+                    addEntrance(first + along * ((k + end) / 2), exit);
+                } else {
+                    addEntrance(first + along * k, exit);
+                    addEntrance(first + along * end, exit);
+                }
+                k = end + 1;
+            }
+        }
+
+        const auto n = entrances.size();
+        auto      &costs = clusters[index(c)].costs;
+        costs.assign(n * n, infinity);
+        for (std::size_t i = 0; i < n; ++i) {
+            searchCluster(index(c), entrances[i].point, false, std::nullopt);
+            for (std::size_t j = 0; j < n; ++j)
+                costs[i * n + j] = localCost(entrances[j].point);
+        }
+    }
+
+    // Numbers the entrances of all clusters as graph nodes
+    auto numberNodes() -> void
+    {
+        firstNodes.resize(clusters.size());
+        nodeClusters.clear();
+        for (std::size_t c = 0; c < clusters.size(); ++c) {
+            firstNodes[c] = static_cast<int>(nodeClusters.size());
+            nodeClusters.insert(nodeClusters.end(), clusters[c].entrances.size(),
+                                static_cast<int>(c));
+        }
+
+        const auto nodes = nodeClusters.size() + 1;
+        nodeCosts.resize(nodes);
+        nodeParents.resize(nodes);
+        nodeSearches.assign(nodes, 0);
+        currentSearch = 0;
+    }
+
+    auto localIndex(const Point2i &p) const -> std::size_t
+    {
+        return index((p.y - localOrigin.y) * localSize.x + p.x - localOrigin.x);
+    }
+
+    auto localCost(const Point2i &p) const -> T { return localCosts[localIndex(p)]; }
+
+    // Dijkstra's algorithm inside cluster c from 'start', or A* until 'target' is reached, which
+    // returns whether it was. Reversed, the costs are of the routes from each point to 'start'.
+    auto searchCluster(std::size_t c, const Point2i &start, bool reverse,
+                       const std::optional<Point2i> &target) -> bool
+    {
+        std::tie(localOrigin, localSize) = clusterRect(c);
+        localCosts.assign(index(localSize.x * localSize.y), infinity);
+        localParents.assign(localCosts.size(), -1);
+
+        const auto pointAt = [&](int i) {
+            return localOrigin + Point2i {i % localSize.x, i / localSize.x};
+        };
+        const auto estimate = [&](const Point2i &p) {
+            return target ? heuristic(p, *target) : T {0};
+        };
+
+        localQueue.clear();
+        localCosts[localIndex(start)] = 0;
+        localQueue.push(estimate(start), 0, static_cast<int>(localIndex(start)));
+
+        while (!localQueue.empty()) {
+            const auto [key, cost, i] = localQueue.pop();
+            if (cost > localCosts[index(i)]) continue;
+
+            const auto p = pointAt(i);
+            if (p == target) return true;
+
+            forEachNeighbor(localSize, i, false, [&](int j, int) {
+                const auto q = pointAt(j);
+                if (blocked(q)) return;
+
+                // reversed, q is left for p on the routes
+                const auto candidateCost = static_cast<T>(cost + (reverse ? steps[p] : steps[q]));
+                if (candidateCost < localCosts[index(j)]) {
+                    localCosts[index(j)] = candidateCost;
+                    localParents[index(j)] = i;
+                    localQueue.push(static_cast<T>(candidateCost + estimate(q)), candidateCost, j);
+                }
+            });
+        }
+
+        return false;
+    }
+
+    // Appends the route of the last searchCluster() to 'to', without its start
+    auto appendLocalRoute(std::vector<Point2i> &ret, const Point2i &to) const -> void
+    {
+        const auto end = ret.size();
+        for (auto i = static_cast<int>(localIndex(to)); localParents[index(i)] >= 0;
+             i = localParents[index(i)])
+            ret.push_back(localOrigin + Point2i {i % localSize.x, i / localSize.x});
+        std::reverse(ret.begin() + static_cast<std::ptrdiff_t>(end), ret.end());
+    }
+
+    // A* over the entrances from the seeds to 'to', which returns whether 'to' was reached. Nodes
+    // reached from seed s have parent -1 - s.
+    auto searchGraph(const Point2i &to, std::size_t goalCluster) -> bool
+    {
+        const auto &goal = clusters[goalCluster].entrances;
+        searchCluster(goalCluster, to, true, std::nullopt);
+        goalCosts.resize(goal.size());
+        for (std::size_t i = 0; i < goal.size(); ++i)
+            goalCosts[i] = localCost(goal[i].point);
+
+        if (++currentSearch == 0) {
+            std::fill(nodeSearches.begin(), nodeSearches.end(), 0);
+            currentSearch = 1;
+        }
+
+        const auto nodeCost = [&](std::size_t n) {
+            return nodeSearches[n] == currentSearch ? nodeCosts[n] : infinity;
+        };
+        const auto reach = [&](std::size_t n, T cost, int parent, const Point2i &p) {
+            if (!(cost < nodeCost(n))) return;
+
+            nodeCosts[n] = cost;
+            nodeParents[n] = parent;
+            nodeSearches[n] = currentSearch;
+            nodeQueue.push(static_cast<T>(cost + heuristic(p, to)), cost, static_cast<int>(n));
+        };
+
+        nodeQueue.clear();
+        for (std::size_t s = 0; s < seeds.size(); ++s) {
+            const auto &seed = seeds[s];
+            searchCluster(seed.cluster, seed.point, false, std::nullopt);
+
+            const auto &entrances = clusters[seed.cluster].entrances;
+            for (std::size_t i = 0; i < entrances.size(); ++i) {
+                const auto cost = localCost(entrances[i].point);
+                if (cost < infinity)
+                    reach(index(firstNodes[seed.cluster]) + i, static_cast<T>(seed.cost + cost),
+                          -1 - static_cast<int>(s), entrances[i].point);
+            }
+        }
+
+        while (!nodeQueue.empty()) {
+            const auto [key, cost, n] = nodeQueue.pop();
+            if (cost > nodeCost(index(n))) continue;
+            if (index(n) == goalNode()) return true;
+
+            const auto  c = index(nodeClusters[index(n)]);
+            const auto &cluster = clusters[c];
+            const auto  count = cluster.entrances.size();
+            const auto  i = index(n - firstNodes[c]);
+            const auto &e = cluster.entrances[i];
+
+            // to the other entrances of the cluster...
+            for (std::size_t j = 0; j < count; ++j) {
+                const auto step = cluster.costs[i * count + j];
+                if (j != i && step < infinity)
+                    reach(index(firstNodes[c]) + j, static_cast<T>(cost + step), n,
+                          cluster.entrances[j].point);
+            }
+
+            // ...across borders...
+            for (std::size_t d = 0; d < directions.size(); ++d) {
+                if ((e.exits & (1U << d)) == 0) continue;
+
+                const auto  q = e.point + directions[d];
+                const auto  c2 = clusterIndex(clusterOf(q));
+                const auto &other = clusters[c2].entrances;
+                const auto  j = std::find_if(other.begin(), other.end(),
+                                             [&](const Entrance &x) { return x.point == q; });
+                if (j == other.end())
+                    throw std::logic_error("HierarchicalAStar: exit without an entrance");
+                reach(index(firstNodes[c2]) + index(static_cast<int>(j - other.begin())),
+                      static_cast<T>(cost + steps[q]), n, q);
+            }
+
+            // ...and to the goal
+            if (c == goalCluster && goalCosts[i] < infinity)
+                reach(goalNode(), static_cast<T>(cost + goalCosts[i]), n, to);
+        }
+
+        return false;
+    }
+};
+
+template <typename T, class Layout>
+HierarchicalAStar(MatrixView<T, Layout>, int = 16)
+    -> HierarchicalAStar<std::remove_const_t<T>, Layout>;
+
+template <typename T, int TileSize>
+HierarchicalAStar(const MatrixSnapshot<T, TileSize> &, int = 16)
+    -> HierarchicalAStar<T, TiledLayout<TileSize>, MatrixSnapshot<T, TileSize>>;
+
+} // namespace mist
+
+#endif
@@ -1,11 +1,17 @@
 #include "MapTools.h"
 
 #include <random>
+#include <stdexcept>
 
 using namespace mist;
 
 DiamondSquare::DiamondSquare(Matrix<double> &output_) : output(output_), size(output.getXSize())
 {
+    // Every step halves the distance between known points, so the size must be 2^n + 1. build()
+    // relies on this to skip bounds checks.
+    const auto N = size - 1;
+    if (output.getYSize() != size || N < 1 || (N & (N - 1)) != 0)
+        throw std::invalid_argument("DiamondSquare needs a square matrix of size 2^n + 1");
 }
 
 auto DiamondSquare::setSeed(long seed_) -> DiamondSquare &
@@ -35,10 +41,10 @@ auto DiamondSquare::build() -> void
     const auto N = size - 1;
 
     // Init corners
-    output.at({0, 0}) = randomize(rng);
-    output.at({0, N}) = randomize(rng);
-    output.at({N, 0}) = randomize(rng);
-    output.at({N, N}) = randomize(rng);
+    output[{0, 0}] = randomize(rng);
+    output[{0, N}] = randomize(rng);
+    output[{N, 0}] = randomize(rng);
+    output[{N, N}] = randomize(rng);
 
     int        stepSize = N;
     auto       noise = initialRandomness;
@@ -48,7 +54,7 @@ auto DiamondSquare::build() -> void
         for (int y = stepSize / 2; y < size; y += stepSize) {
             for (int x = stepSize / 2; x < size; x += stepSize) {
                 const auto total = diamond({x, y}, stepSize / 2) + randomize(rng) * noise;
-                output.at({x, y}) = std::clamp(total, -1.0, 1.0);
+                output[{x, y}] = std::clamp(total, -1.0, 1.0);
             }
         }
 
@@ -56,14 +62,14 @@ auto DiamondSquare::build() -> void
         for (int y = 0; y < size; y += stepSize) {
             for (int x = stepSize / 2; x <= N; x += stepSize) {
                 const auto total = square({x, y}, stepSize / 2) + randomize(rng) * noise;
-                output.at({x, y}) = std::clamp(total, -1.0, 1.0);
+                output[{x, y}] = std::clamp(total, -1.0, 1.0);
             }
         }
         // Square step - odd rows
         for (int y = stepSize / 2; y < N; y += stepSize) {
             for (int x = 0; x <= N; x += stepSize) {
                 const auto total = square({x, y}, stepSize / 2) + randomize(rng) * noise;
-                output.at({x, y}) = std::clamp(total, -1.0, 1.0);
+                output[{x, y}] = std::clamp(total, -1.0, 1.0);
             }
         }
 
@@ -71,12 +77,14 @@ auto DiamondSquare::build() -> void
         stepSize /= 2;
 
     } while (stepSize > 1);
+
+    output.markModified();
 }
 
 auto DiamondSquare::diamond(const Point2i &p, int a) -> double
 {
-    return (output.at({p.x - a, p.y - a}) + output.at({p.x + a, p.y - a}) +
-            output.at({p.x - a, p.y + a}) + output.at({p.x + a, p.y + a})) /
+    return (output[{p.x - a, p.y - a}] + output[{p.x + a, p.y - a}] +
+            output[{p.x - a, p.y + a}] + output[{p.x + a, p.y + a}]) /
            4;
 }
 
@@ -87,7 +95,7 @@ auto DiamondSquare::square(const Point2i &p, int a) -> double
     Point2i src;
 
     auto includePoint = [&](const Point2i &x) {
-        sum += output.at(x);
+        sum += output[x];
         ++N;
     };
 
@@ -1,20 +1,35 @@
 #ifndef MAPTOOLS_H_
 #define MAPTOOLS_H_
 
+#include "CowMatrix.h"
 #include "Matrix.h"
+#include "Parallel.h"
 
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <limits>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <optional>
 #include <set>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace mist
 {
 
-template <typename T, class OutIterator>
-auto addPointsNextTo(const Matrix<T> &m, const Point2i &p0, OutIterator inserter)
+// MapTools algorithms take matrices or views (see MatrixView). On a view, they behave as on a copy
+// of its part of the map, in coordinates relative to the view.
+
+template <MatrixLike M, class OutIterator>
+auto addPointsNextTo(const M &m, const Point2i &p0, OutIterator inserter)
 {
     static constexpr std::array plusMinusOneInCardinalDirs {Point2i {-1, 0}, Point2i {0, -1},
                                                             Point2i {1, 0}, Point2i {0, 1}};
@@ -63,16 +78,26 @@ template <typename T> auto makeDistanceMatrix(int radius) -> Matrix<T>
     return brush;
 }
 
-template <typename T> class MapBrush
+// Calls a function for the points around each of a list of points, with their distance. A brush on
+// a matrix follows it when it's resized or assigned to. A brush on a view is clipped to the view,
+// and must not outlive it (see MatrixView).
+template <typename T, class Layout = RowMajorLayout, class Allocator = std::allocator<T>>
+class MapBrush
 {
 public:
-    MapBrush(Matrix<T> &map_, int radius)
-        : map(map_), brush(mist::makeDistanceMatrix<T>(radius)), brushCenter(radius, radius)
+    MapBrush(Matrix<T, Layout, Allocator> &map_, int radius)
+        : MapBrush(MatrixView<T, Layout>(map_), radius)
+    {
+        matrix = &map_;
+    }
+    MapBrush(MatrixView<T, Layout> map_, int radius)
+        : view(map_), brush(mist::makeDistanceMatrix<T>(radius)), brushCenter(radius, radius)
     {
     }
 
     template <class List, class BrushFunc> auto atPoints(const List &points, BrushFunc func)
     {
+        const auto map = matrix ? MatrixView<T, Layout>(*matrix) : view;
         for (const auto &p0 : points) {
             brush.foreachKeyValue([&](const Point2i &d, const double r) {
                 const auto p = p0 + (d - brushCenter);
@@ -80,21 +105,27 @@ public:
 
                 func(p, r);
             });
+
+            // 'func' may write through operator[], which isn't tracked
+            map.markModified(p0 - brushCenter, brush.getSize());
         }
     }
 
 private:
-    Matrix<T>      &map;
-    mist::Matrix<T> brush;
-    Point2i         brushCenter;
+    Matrix<T, Layout, Allocator> *matrix {nullptr};
+    MatrixView<T, Layout>         view;
+    mist::Matrix<T>               brush;
+    Point2i                       brushCenter;
 };
 
 /* -------------------------------------------------------------------------- */
 
-template <typename T, class FillFunc>
-auto floodFill(const Matrix<T> &map, const Point2i &origin, T maxDistance, T fillUpTo,
-               FillFunc filler) -> void
+template <MatrixLike M, class FillFunc>
+auto floodFill(const M &map, const Point2i &origin, typename M::value_type maxDistance,
+               typename M::value_type fillUpTo, FillFunc filler) -> void
 {
+    using T = typename M::value_type;
+
     std::list<Point2i> frontier {origin};
     std::set<Point2i>  visited;
 
@@ -115,131 +146,1025 @@ auto floodFill(const Matrix<T> &map, const Point2i &origin, T maxDistance, T fil
 
 /* -------------------------------------------------------------------------- */
 
-template <typename T> class AStar
+// Costs to move into the points of a map, for route finding: the map value, offset so the lowest
+// value is at least 1, to the power of the step cost factor. Points above the block value can't be
+// entered, and cost 'blocked'. update() computes costs again only where the map changed, if it
+// tracks modified tiles (see Matrix::trackModifiedTiles()), and the settings and the map minimum,
+// which offsets every step, stayed the same.
+//
+// The map is read through Map: a MatrixView by default, or a MatrixSnapshot, which keeps its own
+// copy of the map. Given a matrix, update() views it again (see MatrixSource), so the matrix may
+// be assigned to between updates if it keeps its size.
+template <typename T, class Layout = RowMajorLayout, class Map = MatrixView<const T, Layout>>
+class StepCosts
 {
+public:
+    static constexpr auto blocked = std::numeric_limits<T>::max();
+
+    explicit StepCosts(MatrixSource<Map> map_)
+        : source(map_), mapStats(source),
+          steps(static_cast<std::size_t>(getSize().x) * static_cast<std::size_t>(getSize().y))
+    {
+    }
+
+    // Brings the costs up to date with the map and settings. Returns true if all costs may have
+    // changed, and otherwise calls changed(origin, size) for each rectangle of changed costs.
+    template <class F> auto update(F changed) -> bool
+    {
+        const auto &map = source.update();
+        const auto revision = map.getRevision();
+        const auto offset = mapOffset();
+        const Settings settings {offset, factor, blockValue};
+        if (current && current->settings == settings) {
+            if (current->revision != revision) {
+                map.foreachModifiedTile(current->revision, [&](const Point2i &origin,
+                                                               const Point2i &size) {
+                    calculate(origin, size, offset);
+                    changed(origin, size);
+                });
+                current->revision = revision;
+            }
+            return false;
+        }
+
+        minStep = blocked;
+        maxStep = 0;
+        calculate({0, 0}, getSize(), offset);
+        current = Current {revision, settings};
+        return true;
+    }
+
+    auto update() -> bool
+    {
+        return update([](const Point2i &, const Point2i &) {});
+    }
+
+    // Cost of the point at row-major index y * xSize + x, as of the last update()
+    [[nodiscard]] auto operator[](std::size_t i) const -> T { return steps[i]; }
+    [[nodiscard]] auto operator[](const Point2i &p) const -> T { return steps[indexOf(p)]; }
+
+    // Lowest and highest cost of a point that can be entered, or 'blocked' and 0 if there is none.
+    // They only spread between updates that change all costs, so they are bounds of the current
+    // costs: every step costs the same if they are equal.
+    [[nodiscard]] auto getMin() const noexcept -> T { return minStep; }
+    [[nodiscard]] auto getMax() const noexcept -> T { return maxStep; }
+
+    [[nodiscard]] auto getSize() const noexcept -> Point2i { return getMap().getSize(); }
+    // As of the last update()
+    [[nodiscard]] auto getMap() const noexcept -> const Map & { return source.get(); }
+
+    auto setFactor(T factor_) -> StepCosts &
+    {
+        factor = factor_;
+        return *this;
+    }
+
+    auto setBlockValue(T blockValue_) -> StepCosts &
+    {
+        blockValue = blockValue_;
+        return *this;
+    }
+
 private:
-    static constexpr auto infinity = std::numeric_limits<T>::max();
+    struct Settings {
+        T offset;
+        T factor;
+        T blockValue;
+
+        auto operator==(const Settings &) const -> bool = default;
+    };
+
+    // Settings and map revision of the costs
+    struct Current {
+        std::uint64_t revision;
+        Settings      settings;
+    };
+
+    MatrixSource<Map>                source;
+    CachedStatistics<T, Layout, Map> mapStats;
+    T                                blockValue {blocked};
+    T                                factor {1};
+    std::vector<T>                   steps;
+    T                                minStep {blocked};
+    T                                maxStep {0};
+    std::optional<Current>           current;
+
+    auto indexOf(const Point2i &p) const -> std::size_t
+    {
+        return static_cast<std::size_t>(p.y * getSize().x + p.x);
+    }
+
+    // offset all map values to make travel costs non-negative. The minimum is only computed again
+    // when the map has changed.
+    auto mapOffset() -> T { return -std::min(static_cast<T>(0), mapStats.get().min) + 1; }
 
+    auto calculate(const Point2i &origin, const Point2i &size, T offset) -> void
+    {
+        const auto &map = getMap();
+        for (auto y = origin.y; y < origin.y + size.y; ++y) {
+            for (auto x = origin.x; x < origin.x + size.x; ++x) {
+                const auto v = map[{x, y}];
+
+                // map values above requested threshold block movement
+                auto step = blocked;
+                if (!(v > blockValue)) {
+                    const auto base = v + offset;
+                    step = static_cast<T>(factor == 1 ? base : std::pow(base, factor));
+                    minStep = std::min(minStep, step);
+                    maxStep = std::max(maxStep, step);
+                }
+                steps[indexOf({x, y})] = step;
+            }
+        }
+    }
+};
+
+/* -------------------------------------------------------------------------- */
+
+// Offsets of the neighbors of a point, the cardinal directions first
+inline constexpr std::array neighborOffsets {
+    Point2i {-1, 0},  Point2i {0, -1}, Point2i {1, 0},  Point2i {0, 1},
+    Point2i {-1, -1}, Point2i {1, -1}, Point2i {-1, 1}, Point2i {1, 1},
+};
+
+// Calls func(j, d) for the neighbors j of point i in a rectangle of 'size', at neighborOffsets[d]
+// from it, with points by flat index y * size.x + x. Diagonal neighbors only if 'diagonals'.
+template <class F> auto forEachNeighbor(const Point2i &size, int i, bool diagonals, F func) -> void
+{
+    const auto x = i % size.x;
+    const auto y = i / size.x;
+    const auto left = x > 0;
+    const auto up = y > 0;
+    const auto right = x < size.x - 1;
+    const auto down = y < size.y - 1;
+
+    if (left) func(i - 1, 0);
+    if (up) func(i - size.x, 1);
+    if (right) func(i + 1, 2);
+    if (down) func(i + size.x, 3);
+    if (!diagonals) return;
+
+    if (left && up) func(i - size.x - 1, 4);
+    if (right && up) func(i - size.x + 1, 5);
+    if (left && down) func(i + size.x - 1, 6);
+    if (right && down) func(i + size.x + 1, 7);
+}
+
+// Binary heap of the points a route search has reached, to expand by lowest key, the cost of the
+// point plus an estimate of the rest of the route. A point reached again for less is pushed
+// again, so a search skips the entries of points that cost less by the time they're popped.
+// clear() keeps the capacity.
+template <typename T> class RouteQueue
+{
 public:
-    AStar(const Matrix<T> &map_) : map(map_), cost(map_.getSize()) {}
+    struct Entry {
+        T   key;
+        T   cost;
+        int point; // or anything else searched, like a node of a graph
+    };
 
-    auto calculate(const Point2i &from) -> AStar &
+    [[nodiscard]] auto empty() const noexcept -> bool { return heap.empty(); }
+
+    auto clear() noexcept -> void { heap.clear(); }
+
+    auto push(T key, T cost, int point) -> void
     {
-        static constexpr std::array plusMinusOneInCardinalDirs {Point2i {-1, 0}, Point2i {0, -1},
-                                                                Point2i {1, 0}, Point2i {0, 1}};
+        heap.push_back({key, cost, point});
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
 
-        // offset all map values to make travel costs non-negative
-        const auto offset = -std::min(static_cast<T>(0), min(map)) + 1;
+    auto pop() -> Entry
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        const auto ret = heap.back();
+        heap.pop_back();
+        return ret;
+    }
 
-        // Reset
-        startPoint = from;
-        cost.fill(infinity);
-        cost.at(from) = 0;
+private:
+    std::vector<Entry> heap;
 
-        std::list<Point2i> frontier;
-        frontier.emplace_back(from);
+    static auto later(const Entry &a, const Entry &b) -> bool { return a.key > b.key; }
+};
 
-        // Explore
-        while (!frontier.empty()) {
-            const auto p0 = frontier.front();
-            frontier.pop_front();
+// Matrix of results that const members fill when asked for, under a lock, so they may be called
+// from several threads at once. Copies start empty, which keeps the classes holding one copyable.
+template <class M> class LazyMatrix
+{
+public:
+    LazyMatrix() = default;
+    LazyMatrix(const LazyMatrix &) {}
 
-            for (const auto &d : plusMinusOneInCardinalDirs) {
-                // expand to surrounding points
-                const auto p = p0 + d;
-                if (!map.contains(p) || p == from) continue;
+    auto operator=(const LazyMatrix &other) -> LazyMatrix &
+    {
+        if (this != &other) {
+            const std::lock_guard lock(mutex);
+            matrix.reset();
+            filled = 0;
+        }
+        return *this;
+    }
 
-                // map values above requested threshold block movement
-                if (map.at(p) > blockValue) continue;
+    // The matrix, made by make() the first time, and filled by fill(matrix) unless it already
+    // holds 'results'
+    template <class Make, class Fill>
+    auto get(std::uint64_t results, Make make, Fill fill) const -> const M &
+    {
+        const std::lock_guard lock(mutex);
+        if (!matrix) matrix.emplace(make());
+        if (filled != results) {
+            fill(*matrix);
+            filled = results;
+        }
+        return *matrix;
+    }
 
-                // total cost to reach 'p' = total cost to 'p0' + cost to move through 'p'
-                const auto candidateCost =
-                    cost.at(p0) + std::pow(map.at(p) + offset, routeCostFactor);
+private:
+    mutable std::mutex       mutex;
+    mutable std::optional<M> matrix;
+    mutable std::uint64_t    filled {0};
+};
+
+// How routes move from a point
+enum class RouteMoves {
+    Cardinal, // to the 4 neighbors in the cardinal directions
+    Diagonal, // to the 8 neighbors, diagonally for sqrt(2) times the step cost, but not between
+              // two points next to a blocked one
+    AnyAngle, // like Diagonal, then routes go straight between the points where they turn, where
+              // that costs no more (see RouteSearch::route())
+};
+
+// State of route searches over StepCosts: the cost and parent of each point, by flat index
+// y * xSize + x, and the binary heap of points to expand. Searches reuse it, so it's allocated
+// once for a map size and a search allocates nothing once the heap has grown. The step costs are
+// only read, so searches with their own RouteSearch can share them.
+//
+// Costs are found with Dijkstra's algorithm, or A* towards a target. When every step costs the
+// same and routes move in the cardinal directions, A* can expand only jump points (JPS): the
+// points where the cheapest routes may have to turn around blocked points. Points must be inside
+// the map.
+template <typename T, class Layout = RowMajorLayout, class Map = MatrixView<const T, Layout>>
+class RouteSearch
+{
+public:
+    using Steps = StepCosts<T, Layout, Map>;
+
+    static constexpr auto infinity = std::numeric_limits<T>::max();
+
+    explicit RouteSearch(const Point2i &size_)
+        : size(size_), costs(area()), searched(area(), 0), parents(area())
+    {
+    }
+
+    // Costs from 'from' to every point, or until the cost of 'to' is known, exploring towards 'to'
+    // first. Costs of points farther away may be left unknown, and such points unreachable. With
+    // 'jumpPoints', when every step costs the same and moves are cardinal, only the costs of the
+    // jump points and of the route to 'to' are known. Returns whether only jump points were
+    // expanded.
+    auto search(const Steps &steps, const Point2i &from, const std::optional<Point2i> &to,
+                RouteMoves moves_, bool jumpPoints) -> bool
+    {
+        if (++currentSearch == 0) {
+            std::fill(searched.begin(), searched.end(), 0);
+            currentSearch = 1;
+        }
+
+        moves = moves_;
+        heap.clear();
+        expansions = 0;
+        setCost(indexOf(from), 0, indexOf(from));
+
+        const auto jump = to && jumpPoints && moves == RouteMoves::Cardinal &&
+                          steps.getMin() == steps.getMax();
+        if (jump) {
+            jumpSearch(steps, from, *to);
+        } else {
+            push(indexOf(from), 0, 0);
+            explore(steps, to);
+        }
+        return jump;
+    }
 
-                // update cost map if we found a better way to reach 'p', and keep expanding from
-                // 'p'
-                if (candidateCost < cost.at(p)) {
-                    cost.at(p) = static_cast<T>(candidateCost);
-                    frontier.emplace_back(p);
+    // Brings the costs of the last search from 'from', which had no target, up to date with
+    // steps.update(). Only the costs that depended on the changed steps are calculated again,
+    // unless all steps changed.
+    auto update(Steps &steps, const Point2i &from) -> void
+    {
+        const auto start = indexOf(from);
+        const auto diagonals = moves != RouteMoves::Cardinal;
+        expansions = 0;
+
+        // Forget the costs of modified points...
+        forgotten.clear();
+        changed.clear();
+        const auto all = steps.update([&](const Point2i &origin, const Point2i &rectSize) {
+            for (auto y = origin.y; y < origin.y + rectSize.y; ++y) {
+                for (auto x = origin.x; x < origin.x + rectSize.x; ++x) {
+                    const auto i = indexOf({x, y});
+                    changed.push_back(i);
+                    forget(i, start);
                 }
             }
+        });
+        if (all) {
+            search(steps, from, std::nullopt, moves, false);
+            return;
         }
 
-        return *this;
+        // ...of the points reached diagonally past them...
+        if (diagonals) {
+            for (const auto q : changed) {
+                forEachNeighbor(size, q, false, [&](int j, int) {
+                    if (costAt(j) == infinity) return;
+
+                    const auto a = pointOf(parents[index(j)]);
+                    const auto b = pointOf(j);
+                    if (std::abs(a.x - b.x) == 1 && std::abs(a.y - b.y) == 1 &&
+                        (indexOf({a.x, b.y}) == q || indexOf({b.x, a.y}) == q))
+                        forget(j, start);
+                });
+            }
+        }
+
+        // ...and of the points reached through forgotten ones
+        for (std::size_t k = 0; k < forgotten.size(); ++k) {
+            const auto i = forgotten[k];
+            forEachNeighbor(size, i, diagonals, [&](int j, int) {
+                if (costAt(j) < infinity && parents[index(j)] == i) forget(j, start);
+            });
+        }
+
+        // Explore again from the known costs around them. Other costs are still right, or improve
+        // through the explored points.
+        heap.clear();
+        const auto pushKnownAround = [&](int i) {
+            if (costAt(i) < infinity) push(i, costAt(i), 0);
+            forEachNeighbor(size, i, diagonals, [&](int j, int) {
+                if (costAt(j) < infinity) push(j, costAt(j), 0);
+            });
+        };
+        for (const auto i : changed)
+            pushKnownAround(i);
+        for (const auto i : forgotten)
+            pushKnownAround(i);
+
+        explore(steps, std::nullopt);
+    }
+
+    // Cost of 'p' found by the last search or update, infinity if unknown
+    [[nodiscard]] auto getCost(const Point2i &p) const -> T { return costAt(indexOf(p)); }
+
+    // Writes the route from the start of the last search to 'to' in 'route', following the parents
+    // the search recorded, or clears it if the cost of 'to' is unknown. The capacity of 'route' is
+    // reused.
+    //
+    // With any-angle moves, the route only holds the points where it turns: from each point, it
+    // goes straight to the farthest point of the route that the point sees, if the straight line
+    // costs no more than the route between them (see lineCost()).
+    auto route(const Steps &steps, const Point2i &to, std::vector<Point2i> &route) const -> void
+    {
+        route.clear();
+
+        auto i = indexOf(to);
+        if (costAt(i) == infinity) return;
+
+        for (; i != parents[index(i)]; i = parents[index(i)]) {
+            // parents are next to their points, or in a straight line after a jump
+            const auto    a = pointOf(parents[index(i)]);
+            auto          q = pointOf(i);
+            const Point2i d {sign(a.x - q.x), sign(a.y - q.y)};
+            for (; q != a; q += d)
+                route.push_back(q);
+        }
+        route.push_back(pointOf(i));
+
+        std::reverse(route.begin(), route.end());
+        if (moves == RouteMoves::AnyAngle) straighten(steps, route);
+    }
+
+    [[nodiscard]] auto getSize() const noexcept -> Point2i { return size; }
+
+    // Points expanded by the last search or update
+    [[nodiscard]] auto getExpansions() const noexcept -> std::size_t { return expansions; }
+
+private:
+    Point2i    size;
+    RouteMoves moves {RouteMoves::Cardinal};
+
+    // Costs and parents are only valid where 'searched' is the current search; a new search just
+    // starts a new one instead of resetting every cost
+    std::vector<T>             costs;
+    std::vector<std::uint32_t> searched;
+    std::uint32_t              currentSearch {0};
+    std::vector<int>           parents; // the start is its own parent
+    RouteQueue<T>              heap;
+    Point2i                    heuristicTarget;
+    std::size_t                expansions {0};
+
+    // of update(), kept for their capacity
+    std::vector<int> forgotten;
+    std::vector<int> changed;
+
+    auto area() const -> std::size_t
+    {
+        return static_cast<std::size_t>(size.x) * static_cast<std::size_t>(size.y);
+    }
+
+    auto indexOf(const Point2i &p) const -> int { return p.y * size.x + p.x; }
+    auto pointOf(int i) const -> Point2i { return {i % size.x, i / size.x}; }
+    static auto index(int i) -> std::size_t { return static_cast<std::size_t>(i); }
+    static auto sign(int v) -> int { return (v > 0) - (v < 0); }
+
+    auto costAt(int i) const -> T
+    {
+        return searched[index(i)] == currentSearch ? costs[index(i)] : infinity;
+    }
+
+    auto setCost(int i, T c, int parent) -> void
+    {
+        costs[index(i)] = c;
+        searched[index(i)] = currentSearch;
+        parents[index(i)] = parent;
+    }
+
+    auto forget(int i, int start) -> void
+    {
+        if (i == start || costAt(i) == infinity) return;
+
+        setCost(i, infinity, i);
+        forgotten.push_back(i);
+    }
+
+    auto push(int i, T c, T heuristicScale) -> void
+    {
+        auto key = c;
+        if (heuristicScale > 0) {
+            const auto dx = std::abs(i % size.x - heuristicTarget.x);
+            const auto dy = std::abs(i / size.x - heuristicTarget.y);
+            if (moves == RouteMoves::Cardinal) {
+                key += heuristicScale * static_cast<T>(dx + dy);
+            } else {
+                const auto distance =
+                    std::max(dx, dy) + (std::numbers::sqrt2 - 1) * std::min(dx, dy);
+                key += static_cast<T>(static_cast<double>(heuristicScale) * distance);
+            }
+        }
+
+        heap.push(key, c, i);
+    }
+
+    // Dijkstra's algorithm from the points in the heap, or A* until 'to' is reached. No step costs
+    // less than the lowest step cost, so that times the distance to 'to' never overestimates the
+    // rest of a route, and costs are final when their point leaves the heap.
+    auto explore(const Steps &steps, const std::optional<Point2i> &to) -> void
+    {
+        const auto target = to ? indexOf(*to) : -1;
+        const auto heuristicScale = to && steps.getMin() < infinity ? steps.getMin() : T {0};
+        const auto diagonals = moves != RouteMoves::Cardinal;
+        if (to) heuristicTarget = *to;
+
+        while (!heap.empty()) {
+            const auto [key, c, i] = heap.pop();
+
+            if (c > costAt(i)) continue;
+            if (i == target) return;
+            ++expansions;
+
+            forEachNeighbor(size, i, diagonals, [&](int j, int d) {
+                const auto step = steps[index(j)];
+                if (step == Steps::blocked) return;
+
+                // total cost to reach 'j' = total cost to 'i' + cost to move into 'j'
+                auto       move = step;
+                const auto offset = neighborOffsets[index(d)];
+                if (offset.x != 0 && offset.y != 0) {
+                    if (steps[index(i + offset.x)] == Steps::blocked ||
+                        steps[index(i + offset.y * size.x)] == Steps::blocked)
+                        return;
+                    move = static_cast<T>(static_cast<double>(step) * std::numbers::sqrt2);
+                }
+
+                const auto candidateCost = static_cast<T>(c + move);
+                if (candidateCost < costAt(j)) {
+                    setCost(j, candidateCost, i);
+                    push(j, candidateCost, heuristicScale);
+                }
+            });
+        }
+    }
+
+    // Removes the points of 'route' where it doesn't have to turn, as route() describes
+    auto straighten(const Steps &steps, std::vector<Point2i> &route) const -> void
+    {
+        if (route.size() < 3) return;
+
+        // up to rounding
+        const auto straight = [&](const Point2i &a, const Point2i &b) {
+            const auto line = lineCost(steps, a, b);
+            const auto routeCost = static_cast<double>(costAt(indexOf(b)) - costAt(indexOf(a)));
+            return line && static_cast<double>(*line) <= routeCost * (1 + 1e-9);
+        };
+
+        // route[kept] is the last point kept, and goes straight to the points before k
+        std::size_t kept = 0;
+        for (std::size_t k = 2; k < route.size(); ++k) {
+            if (!straight(route[kept], route[k])) {
+                route[kept + 1] = route[k - 1];
+                ++kept;
+            }
+        }
+        route[kept + 1] = route.back();
+        route.resize(kept + 2);
     }
 
-    [[nodiscard]] auto canReach(const Point2i &p) const -> bool { return cost.at(p) < infinity; }
+    // Cost of moving in a straight line from 'a' to 'b', its length times the average cost of the
+    // points it enters, or nothing if it enters a blocked point or passes diagonally between two
+    // points next to a blocked one. The line goes from center to center, entering the points whose
+    // borders it crosses next.
+    auto lineCost(const Steps &steps, const Point2i &a, const Point2i &b) const -> std::optional<T>
+    {
+        const auto    nx = std::abs(b.x - a.x);
+        const auto    ny = std::abs(b.y - a.y);
+        const Point2i d {sign(b.x - a.x), sign(b.y - a.y)};
+        const auto    blocked = [&](const Point2i &p) {
+            return steps[index(indexOf(p))] == Steps::blocked;
+        };
+
+        auto p = a;
+        T    sum {0};
+        int  entered = 0;
+        for (int ix = 0, iy = 0; ix < nx || iy < ny;) {
+            // the line crosses a vertical border first if this is negative, a corner if 0
+            const auto next = (1 + 2 * ix) * ny - (1 + 2 * iy) * nx;
+            if (next == 0) {
+                if (blocked({p.x + d.x, p.y}) || blocked({p.x, p.y + d.y})) return std::nullopt;
+                p += d;
+                ++ix;
+                ++iy;
+            } else if (next < 0) {
+                p.x += d.x;
+                ++ix;
+            } else {
+                p.y += d.y;
+                ++iy;
+            }
+
+            if (blocked(p)) return std::nullopt;
+            sum = static_cast<T>(sum + steps[index(indexOf(p))]);
+            ++entered;
+        }
+
+        return static_cast<T>(static_cast<double>(sum) * std::hypot(nx, ny) / entered);
+    }
 
-    auto route(const Point2i &endPoint) -> std::list<Point2i>
+    auto open(const Steps &steps, const Point2i &p) const -> bool
     {
-        static constexpr std::array plusMinusOneInCardinalDirs {Point2i {-1, 0}, Point2i {0, -1},
-                                                                Point2i {1, 0}, Point2i {0, 1}};
+        return p.x >= 0 && p.x < size.x && p.y >= 0 && p.y < size.y &&
+               steps[index(indexOf(p))] != Steps::blocked;
+    }
 
-        // Start from the end...
-        std::list<Point2i> ret;
-        Point2i            p0 = endPoint;
+    // Whether moving horizontally by dx into 'p', the point at dy from it can only be reached as
+    // cheaply through 'p'
+    auto forced(const Steps &steps, const Point2i &p, int dx, int dy) const -> bool
+    {
+        return open(steps, {p.x, p.y + dy}) && !open(steps, {p.x - dx, p.y + dy});
+    }
 
-        // ...and follow the lowest cost until we reach the start
-        while (p0 != startPoint) {
-            ret.emplace_back(p0);
+    // Next jump point from 'p' in direction 'dir', if any
+    auto jump(const Steps &steps, Point2i p, const Point2i &dir, const Point2i &to) const
+        -> std::optional<Point2i>
+    {
+        for (;;) {
+            p += dir;
+            if (!open(steps, p)) return std::nullopt;
+            if (p == to) return p;
 
-            // Search for lowest cost surrounding 'p0'
-            Point2i bestPoint;
-            T       bestValue = infinity;
-            for (const auto &d : plusMinusOneInCardinalDirs) {
-                const auto p = p0 + d;
-                if (!map.contains(p)) continue;
-                if (cost.at(p) < bestValue) {
-                    bestPoint = p;
-                    bestValue = cost.at(p);
+            if (dir.x != 0) {
+                if (forced(steps, p, dir.x, -1) || forced(steps, p, dir.x, 1)) return p;
+            } else if (jump(steps, p, {-1, 0}, to) || jump(steps, p, {1, 0}, to)) {
+                return p;
+            }
+        }
+    }
+
+    // A* from 'from' to 'to' over jump points, when every step costs the same. Of the cheapest
+    // routes, only those that move vertically first, and turn vertically again only around blocked
+    // points, are followed: moving vertically, each row is scanned both ways for jump points, and
+    // moving horizontally stops where a point above or below opens up behind a blocked one.
+    auto jumpSearch(const Steps &steps, const Point2i &from, const Point2i &to) -> void
+    {
+        const auto step = steps.getMin();
+        heuristicTarget = to;
+        push(indexOf(from), 0, step);
+
+        while (!heap.empty()) {
+            const auto [key, c, i] = heap.pop();
+
+            if (c > costAt(i)) continue;
+            if (i == indexOf(to)) break;
+            ++expansions;
+
+            const auto p = pointOf(i);
+            const auto previous = pointOf(parents[index(i)]);
+            const auto jumpTo = [&](const Point2i &dir) {
+                const auto next = jump(steps, p, dir, to);
+                if (!next) return;
+
+                const auto j = indexOf(*next);
+                const auto distance = std::abs(next->x - p.x) + std::abs(next->y - p.y);
+                const auto candidateCost = static_cast<T>(c + step * static_cast<T>(distance));
+                if (candidateCost < costAt(j)) {
+                    setCost(j, candidateCost, i);
+                    push(j, candidateCost, step);
                 }
+            };
+
+            // from the start, or vertically
+            if (p.x == previous.x) {
+                if (p.y >= previous.y) jumpTo({0, 1});
+                if (p.y <= previous.y) jumpTo({0, -1});
+                jumpTo({-1, 0});
+                jumpTo({1, 0});
+                continue;
             }
 
-            p0 = bestPoint;
+            const auto dx = sign(p.x - previous.x);
+            jumpTo({dx, 0});
+            for (const auto dy : {-1, 1}) {
+                if (forced(steps, p, dx, dy)) jumpTo({0, dy});
+            }
         }
 
-        ret.emplace_back(p0);
+        // costs of the points between the jump points on the route
+        if (costAt(indexOf(to)) == infinity) return;
+        for (auto i = indexOf(to); i != parents[index(i)]; i = parents[index(i)]) {
+            const auto a = pointOf(parents[index(i)]);
+            const auto b = pointOf(i);
+            const Point2i d {sign(b.x - a.x), sign(b.y - a.y)};
+
+            auto routeCost = costAt(indexOf(a));
+            for (auto q = a + d; q != b; q += d) {
+                routeCost = static_cast<T>(routeCost + step);
+                setCost(indexOf(q), routeCost, indexOf(a));
+            }
+        }
+    }
+};
+
+/* -------------------------------------------------------------------------- */
+
+// Costs of routes over a map from a start point, with the step costs of StepCosts, found by a
+// RouteSearch. Routes move in the cardinal directions unless set otherwise (see RouteMoves). When
+// every step costs the same, cardinal routes to a target only expand jump points.
+//
+// AStar reads the map through Map, as StepCosts does: a matrix must outlive the AStar and keep its
+// size, but may be changed or assigned to between calculations (see update()).
+template <typename T, class Layout = RowMajorLayout, class Allocator = std::allocator<T>,
+          class Map = MatrixView<const T, Layout>>
+class AStar
+{
+private:
+    static constexpr auto infinity = std::numeric_limits<T>::max();
+
+public:
+    AStar(const Matrix<T, Layout, Allocator> &map_)
+        : AStar(MatrixSource<Map>(map_), map_.getAllocator())
+    {
+    }
+    AStar(MatrixSource<Map> map_, const Allocator &allocator_ = Allocator())
+        : allocator(allocator_), steps(map_), state(steps.getSize())
+    {
+    }
+
+    // Costs from 'from' to every point
+    auto calculate(const Point2i &from) -> AStar & { return search(from, std::nullopt); }
+
+    // Costs from 'from' until the cost of 'to' is known, exploring towards 'to' first. Costs of
+    // points farther away may be left unknown, and such points unreachable. With jump points, only
+    // the costs of the jump points and of the route to 'to' are known.
+    auto calculate(const Point2i &from, const Point2i &to) -> AStar & { return search(from, to); }
+
+    // Brings the costs of the last calculate() up to date with the changes to the map since. Only
+    // the costs that depended on the modified tiles of the map (see Matrix::trackModifiedTiles())
+    // are calculated again, unless the changes move the map minimum, which offsets every step, or
+    // the settings changed, or the last calculate() had a target.
+    auto update() -> AStar &
+    {
+        if (!last) throw std::logic_error("AStar::update() before calculate()");
+
+        // the costs to repair were found with other moves
+        if (last->target || last->moves != moves) return search(startPoint, last->target);
+
+        state.update(steps, startPoint);
+        ++results;
+        return *this;
+    }
+
+    [[nodiscard]] auto canReach(const Point2i &p) const -> bool
+    {
+        if (!steps.getMap().contains(p)) throw std::out_of_range("AStar::canReach");
+        return state.getCost(p) < infinity;
+    }
+
+    // Route from 'endPoint' back to the start of the last calculation, following the parents the
+    // calculation recorded, or an empty route if 'endPoint' can't be reached. With any-angle moves,
+    // only the points where the route turns.
+    [[nodiscard]] auto route(const Point2i &endPoint) const -> std::vector<Point2i>
+    {
+        std::vector<Point2i> ret;
+        route(endPoint, ret);
         return ret;
     }
 
-    [[nodiscard]] auto getCost() const noexcept -> const Matrix<T> & { return cost; }
+    // Writes the route of route(endPoint) to 'ret', reusing its capacity
+    auto route(const Point2i &endPoint, std::vector<Point2i> &ret) const -> void
+    {
+        if (!steps.getMap().contains(endPoint)) throw std::out_of_range("AStar::route");
+
+        state.route(steps, endPoint, ret);
+        std::reverse(ret.begin(), ret.end());
+    }
+
+    // Costs of the last calculation, infinity where unknown. Filled on the first call after a
+    // calculation, which may come from several threads at once, like calls of the other const
+    // members.
+    [[nodiscard]] auto getCost() const -> const Matrix<T, Layout, Allocator> &
+    {
+        return cost.get(
+            results,
+            [&] {
+                return Matrix<T, Layout, Allocator>(steps.getSize(), allocator);
+            },
+            [&](Matrix<T, Layout, Allocator> &m) {
+                m.generate([&](const Point2i &p) {
+                    return state.getCost(p);
+                });
+            });
+    }
 
     auto setStepCostFactor(T a) -> AStar &
     {
-        routeCostFactor = a;
+        steps.setFactor(a);
         return *this;
     }
 
     auto setBlockValue(T blockValue_) -> AStar &
     {
-        blockValue = blockValue_;
+        steps.setBlockValue(blockValue_);
+        return *this;
+    }
+
+    // Whether calculate(from, to) expands only jump points when every step costs the same and
+    // moves are cardinal. On by default.
+    auto setJumpPoints(bool enabled) -> AStar &
+    {
+        jumpPoints = enabled;
+        return *this;
+    }
+
+    auto setMoves(RouteMoves moves_) -> AStar &
+    {
+        moves = moves_;
+        return *this;
+    }
+
+    // Points expanded by the last calculation or update
+    [[nodiscard]] auto getExpansions() const noexcept -> std::size_t
+    {
+        return state.getExpansions();
+    }
+
+private:
+    struct Calculation {
+        std::optional<Point2i> target;
+        RouteMoves             moves;
+    };
+
+    Allocator                   allocator;
+    StepCosts<T, Layout, Map>   steps;
+    RouteSearch<T, Layout, Map> state;
+    Point2i                     startPoint;
+    std::optional<Calculation>  last;
+    bool                        jumpPoints {true};
+    RouteMoves                  moves {RouteMoves::Cardinal};
+
+    // Costs as a matrix, filled from 'state' when asked for
+    LazyMatrix<Matrix<T, Layout, Allocator>> cost;
+    std::uint64_t                            results {0};
+
+    auto search(const Point2i &from, const std::optional<Point2i> &to) -> AStar &
+    {
+        const auto &map = steps.getMap();
+        if (!map.contains(from) || (to && !map.contains(*to)))
+            throw std::out_of_range("AStar::calculate: point outside the map");
+
+        steps.update();
+
+        startPoint = from;
+        state.search(steps, from, to, moves, jumpPoints);
+        last = Calculation {to, moves};
+        ++results;
+        return *this;
+    }
+};
+
+template <typename T, int TileSize>
+AStar(const MatrixSnapshot<T, TileSize> &)
+    -> AStar<T, TiledLayout<TileSize>, std::allocator<T>, MatrixSnapshot<T, TileSize>>;
+
+/* -------------------------------------------------------------------------- */
+
+// Cheapest routes between many pairs of points over one map, searched on up to threadCount threads
+// (0 = one per core), with the step costs and settings of AStar. The step costs are brought up to
+// date once per batch and then only read, so every thread shares them. The threads wait in a
+// WorkerPool between batches, and each searches with its own RouteSearch, kept for later batches:
+// once every thread has searched, a batch only allocates to grow the routes it returns.
+template <typename T, class Layout = RowMajorLayout, class Map = MatrixView<const T, Layout>>
+class ParallelRoutes
+{
+public:
+    // from, to
+    using Query = std::pair<Point2i, Point2i>;
+
+    template <class Allocator>
+    explicit ParallelRoutes(const Matrix<T, Layout, Allocator> &map, int threadCount = 0)
+        : ParallelRoutes(MatrixSource<Map>(map), threadCount)
+    {
+    }
+
+    explicit ParallelRoutes(MatrixSource<Map> map, int threadCount = 0)
+        : steps(map), workers(threadCount),
+          searches(static_cast<std::size_t>(workers.getThreadCount()))
+    {
+    }
+
+    // Writes the route of queries[i] to routes[i], from 'from' to 'to' like
+    // HierarchicalAStar::route() (AStar::route() goes back from the end), or empty if 'to' can't
+    // be reached. The vectors of 'routes' are reused. Throws std::out_of_range, before searching,
+    // if a point is outside the map.
+    auto routesFromTo(const std::vector<Query> &queries,
+                      std::vector<std::vector<Point2i>> &routes) -> void
+    {
+        const auto &map = steps.getMap();
+        for (const auto &[from, to] : queries) {
+            if (!map.contains(from) || !map.contains(to))
+                throw std::out_of_range("ParallelRoutes::routesFromTo: point outside the map");
+        }
+
+        steps.update();
+        routes.resize(queries.size());
+
+        workers.run(static_cast<int>(queries.size()), [&](int task, int worker) {
+            auto &search = searches[static_cast<std::size_t>(worker)];
+            if (!search) search.emplace(steps.getSize());
+
+            const auto &[from, to] = queries[static_cast<std::size_t>(task)];
+            search->search(steps, from, to, moves, jumpPoints);
+            search->route(steps, to, routes[static_cast<std::size_t>(task)]);
+        });
+    }
+
+    [[nodiscard]] auto routesFromTo(const std::vector<Query> &queries)
+        -> std::vector<std::vector<Point2i>>
+    {
+        std::vector<std::vector<Point2i>> routes;
+        routesFromTo(queries, routes);
+        return routes;
+    }
+
+    auto setStepCostFactor(T a) -> ParallelRoutes &
+    {
+        steps.setFactor(a);
+        return *this;
+    }
+
+    auto setBlockValue(T blockValue_) -> ParallelRoutes &
+    {
+        steps.setBlockValue(blockValue_);
+        return *this;
+    }
+
+    // Whether only jump points are expanded when every step costs the same, like
+    // AStar::setJumpPoints(). On by default.
+    auto setJumpPoints(bool enabled) -> ParallelRoutes &
+    {
+        jumpPoints = enabled;
+        return *this;
+    }
+
+    auto setMoves(RouteMoves moves_) -> ParallelRoutes &
+    {
+        moves = moves_;
         return *this;
     }
 
 private:
-    const Matrix<T> &map;
-    Matrix<T>        cost;
-    T                blockValue {infinity};
-    T                routeCostFactor {1};
-    Point2i          startPoint;
+    StepCosts<T, Layout, Map>                               steps;
+    WorkerPool                                              workers;
+    std::vector<std::optional<RouteSearch<T, Layout, Map>>> searches; // by worker
+    bool                                                    jumpPoints {true};
+    RouteMoves                                              moves {RouteMoves::Cardinal};
 };
 
+template <typename T, class Layout>
+ParallelRoutes(MatrixView<T, Layout>, int = 0) -> ParallelRoutes<std::remove_const_t<T>, Layout>;
+
+template <typename T, int TileSize>
+ParallelRoutes(const MatrixSnapshot<T, TileSize> &, int = 0)
+    -> ParallelRoutes<T, TiledLayout<TileSize>, MatrixSnapshot<T, TileSize>>;
+
 /* -------------------------------------------------------------------------- */
 
-template <typename T> auto calculateGradient(const Matrix<T> &src) -> Matrix<Point2<T>>
+// Writes the gradient of 'src' in the rectangle of 'size' at 'origin' to the same points of 'grad',
+// a matrix or writable view of the same size
+template <MatrixLike Src, class Grad>
+    requires MatrixLike<std::remove_cvref_t<Grad>>
+auto calculateGradient(const Src &src, Grad &&grad, const Point2i &origin, const Point2i &size)
+    -> void
 {
-    Matrix<Point2<T>> grad(src.getSize());
+    using T = typename Src::value_type;
+
+    if (grad.getSize() != src.getSize())
+        throw std::invalid_argument("calculateGradient: sizes differ");
+    if (!rectangleInside(src.getSize(), origin, size))
+        throw std::out_of_range("calculateGradient: rectangle outside the matrix");
+    if (size.x == 0 || size.y == 0) return;
+
+    // the gradient is 0 towards points past the last row or column
+    using GradLayout = typename std::remove_cvref_t<Grad>::layout_type;
+    const auto xEnd = origin.x + size.x;
+    const auto yEnd = origin.y + size.y;
+
+    if constexpr (Src::layout_type::contiguousRows && GradLayout::contiguousRows) {
+        const auto last = static_cast<std::size_t>(src.getXSize() - 1);
+        const auto xBegin = static_cast<std::size_t>(origin.x);
+        const auto xInner = std::min(static_cast<std::size_t>(xEnd), last);
 
-    src.foreachKeyValue([&](const Point2i &p, T v) {
-        Point2i x1 {p.x + 1, p.y};
-        Point2i y1 {p.x, p.y + 1};
+        for (auto y = origin.y; y < yEnd; ++y) {
+            const auto row = src.row(y);
+            const auto next = src.row(std::min(y + 1, src.getYSize() - 1));
+            const auto out = grad.row(y);
 
-        const auto dx = (src.contains(x1) ? src.at(x1) : v) - v;
-        const auto dy = (src.contains(y1) ? src.at(y1) : v) - v;
+            for (auto x = xBegin; x < xInner; ++x)
+                out[x] = {row[x + 1] - row[x], next[x] - row[x]};
 
-        grad.at(p) = {dx, dy};
+            if (xEnd == src.getXSize()) out[last] = {T {}, next[last] - row[last]};
+        }
+    } else {
+        const auto last = src.getXSize() - 1;
+
+        for (auto y = origin.y; y < yEnd; ++y) {
+            const auto yNext = std::min(y + 1, src.getYSize() - 1);
+
+            for (auto x = origin.x; x < xEnd; ++x) {
+                const auto v = src[{x, y}];
+                grad[{x, y}] = {src[{std::min(x + 1, last), y}] - v, src[{x, yNext}] - v};
+            }
+        }
+    }
+
+    grad.markModified(origin, size);
+}
+
+// Writes the gradient of 'src' to 'grad', a matrix or writable view of the same size
+template <MatrixLike Src, class Grad>
+    requires MatrixLike<std::remove_cvref_t<Grad>>
+auto calculateGradient(const Src &src, Grad &&grad) -> void
+{
+    calculateGradient(src, grad, {0, 0}, src.getSize());
+}
+
+// Brings 'grad', the gradient of 'src' at revision 'since' (see Matrix::getRevision()), up to date
+// by calculating it again around the tiles of 'src' modified since. Returns the revision of 'src'
+// to pass next time.
+template <MatrixLike Src, class Grad>
+    requires MatrixLike<std::remove_cvref_t<Grad>>
+auto updateGradient(const Src &src, Grad &&grad, std::uint64_t since) -> std::uint64_t
+{
+    const auto current = src.getRevision();
+    src.foreachModifiedTile(since, [&](const Point2i &origin, const Point2i &size) {
+        // the gradient of the points left of and above a tile depends on it too
+        const Point2i from {std::max(origin.x - 1, 0), std::max(origin.y - 1, 0)};
+        calculateGradient(src, grad, from, origin + size - from);
     });
+    return current;
+}
 
+template <typename T, class Layout, class Allocator>
+auto calculateGradient(const Matrix<T, Layout, Allocator> &src)
+    -> Matrix<Point2<T>, Layout, RebindAllocator<Allocator, Point2<T>>>
+{
+    Matrix<Point2<T>, Layout, RebindAllocator<Allocator, Point2<T>>> grad(src.getSize(),
+                                                                          src.getAllocator());
+    calculateGradient(src, grad);
+    return grad;
+}
+
+template <typename T, class Layout>
+auto calculateGradient(MatrixView<T, Layout> src) -> Matrix<Point2<std::remove_const_t<T>>, Layout>
+{
+    Matrix<Point2<std::remove_const_t<T>>, Layout> grad(src.getSize());
+    calculateGradient(src, grad);
     return grad;
 }
 
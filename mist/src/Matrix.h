@@ -1,47 +1,323 @@
 #ifndef MATRIX_H_
 #define MATRIX_H_
 
+#include "AlignedAllocator.h"
+#include "MatrixLayout.h"
+#include "Parallel.h"
 #include "Point.h"
+#include "Statistics.h"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace mist
 {
 
-template <typename T> class Matrix
+// Number that changes whenever a matrix is modified. Copies start over, and assignment counts as a
+// modification. Concurrent changes may be counted once, which is enough to tell that something
+// changed.
+//
+// With tile tracking (see Matrix::trackModifiedTiles()), the matrix is also divided into square
+// tiles that remember the revision of their last modification, so results computed from the
+// matrix can be brought up to date where it changed only. Copies keep tracking, with no tile
+// modified.
+class MatrixRevision
+{
+public:
+    MatrixRevision() = default;
+    MatrixRevision(const MatrixRevision &other)
+        : matrixSize(other.matrixSize), tileShift(other.tileShift), xTiles(other.xTiles),
+          tiles(other.tiles.size())
+    {
+    }
+    auto operator=(const MatrixRevision &other) -> MatrixRevision &
+    {
+        if (this != &other) {
+            matrixSize = other.matrixSize;
+            tileShift = other.tileShift;
+            xTiles = other.xTiles;
+            tiles = std::vector<std::atomic<std::uint64_t>>(other.tiles.size());
+        }
+        bump();
+        return *this;
+    }
+
+    [[nodiscard]] auto get() const noexcept -> std::uint64_t
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    // Modification of the whole matrix
+    auto bump() noexcept -> void { whole.store(next(), std::memory_order_relaxed); }
+
+    // Modification of point 'p' only
+    auto bump(const Point2i &p) noexcept -> void
+    {
+        const auto v = next();
+        if (tiles.empty() || !inside(p)) {
+            whole.store(v, std::memory_order_relaxed);
+            return;
+        }
+        tiles[tileIndex(p.x >> tileShift, p.y >> tileShift)].store(v, std::memory_order_relaxed);
+    }
+
+    // Modification of the rectangle of 'size' at 'origin', clipped to the matrix
+    auto bump(const Point2i &origin, const Point2i &size) noexcept -> void
+    {
+        if (tiles.empty()) {
+            bump();
+            return;
+        }
+
+        const auto v = next();
+        forEachTile(origin, size, [&](int tx, int ty, const Point2i &, const Point2i &) {
+            tiles[tileIndex(tx, ty)].store(v, std::memory_order_relaxed);
+        });
+    }
+
+    // Divides a matrix of 'matrixSize_' into tiles of 'tileSize', a power of two, all unmodified
+    auto trackTiles(const Point2i &matrixSize_, int tileSize) -> void
+    {
+        if (tileSize <= 0 || !std::has_single_bit(static_cast<unsigned>(tileSize)))
+            throw std::invalid_argument("Tile size must be a power of two");
+
+        matrixSize = matrixSize_;
+        tileShift = std::countr_zero(static_cast<unsigned>(tileSize));
+        xTiles = (matrixSize.x + tileSize - 1) >> tileShift;
+        const auto yTiles = (matrixSize.y + tileSize - 1) >> tileShift;
+        tiles = std::vector<std::atomic<std::uint64_t>>(static_cast<std::size_t>(xTiles * yTiles));
+    }
+
+    // 0 without tile tracking
+    [[nodiscard]] auto getTileSize() const noexcept -> int
+    {
+        return tiles.empty() ? 0 : 1 << tileShift;
+    }
+
+    // Calls func(origin, size) for the parts of the rectangle of 'size' at 'origin' in tiles
+    // modified after revision 'since'. Without tile tracking, the rectangle is a single tile.
+    template <class F>
+    auto foreachModifiedTile(std::uint64_t since, const Point2i &origin, const Point2i &size,
+                             F func) const -> void
+    {
+        const auto all = whole.load(std::memory_order_relaxed) > since;
+        if (tiles.empty()) {
+            if (all && size.x > 0 && size.y > 0) func(origin, size);
+            return;
+        }
+
+        forEachTile(origin, size, [&](int tx, int ty, const Point2i &o, const Point2i &s) {
+            if (all || tiles[tileIndex(tx, ty)].load(std::memory_order_relaxed) > since)
+                func(o, s);
+        });
+    }
+
+private:
+    std::atomic<std::uint64_t> value {0};
+    std::atomic<std::uint64_t> whole {0}; // revision of the last modification of everything
+
+    Point2i                                 matrixSize {0, 0};
+    int                                     tileShift {0};
+    int                                     xTiles {0};
+    std::vector<std::atomic<std::uint64_t>> tiles;
+
+    auto next() noexcept -> std::uint64_t
+    {
+        const auto v = get() + 1;
+        value.store(v, std::memory_order_relaxed);
+        return v;
+    }
+
+    auto inside(const Point2i &p) const noexcept -> bool
+    {
+        return p.x >= 0 && p.x < matrixSize.x && p.y >= 0 && p.y < matrixSize.y;
+    }
+
+    auto tileIndex(int tx, int ty) const noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(ty * xTiles + tx);
+    }
+
+    // Calls func(tx, ty, origin, size) for the tiles overlapping the rectangle, with the overlap
+    template <class F>
+    auto forEachTile(const Point2i &origin, const Point2i &size, F func) const -> void
+    {
+        const Point2i from {std::max(origin.x, 0), std::max(origin.y, 0)};
+        const Point2i to {std::min(origin.x + size.x, matrixSize.x),
+                          std::min(origin.y + size.y, matrixSize.y)};
+        if (from.x >= to.x || from.y >= to.y) return;
+
+        for (auto ty = from.y >> tileShift; ty <= (to.y - 1) >> tileShift; ++ty) {
+            const auto y0 = std::max(from.y, ty << tileShift);
+            const auto y1 = std::min(to.y, (ty + 1) << tileShift);
+
+            for (auto tx = from.x >> tileShift; tx <= (to.x - 1) >> tileShift; ++tx) {
+                const auto x0 = std::max(from.x, tx << tileShift);
+                const auto x1 = std::min(to.x, (tx + 1) << tileShift);
+                func(tx, ty, Point2i {x0, y0}, Point2i {x1 - x0, y1 - y0});
+            }
+        }
+    }
+};
+
+// Whether the rectangle of 'size' at 'origin' is inside a matrix of 'matrixSize'. Empty rectangles
+// are always inside.
+inline auto rectangleInside(const Point2i &matrixSize, const Point2i &origin, const Point2i &size)
+    -> bool
+{
+    if (size.x < 0 || size.y < 0) return false;
+    if (size.x == 0 || size.y == 0) return true;
+
+    return origin.x >= 0 && origin.y >= 0 && origin.x + size.x <= matrixSize.x &&
+           origin.y + size.y <= matrixSize.y;
+}
+
+template <typename T, class Layout> class MatrixView;
+
+// 2D array of T. The storage order is set by Layout (see MatrixLayout.h) and only affects
+// performance: iteration is always in row-major order of keys. Storage comes from Allocator.
+//
+// getRevision() changes with every modification made through non-const at(), begin() and the
+// operations that write values, so results computed from a matrix can be cached (see
+// CachedStatistics). Writes through operator[], row() and paddedRow() aren't tracked, for speed;
+// call markModified() after them. trackModifiedTiles() also records where the matrix changed, for
+// incremental updates of such results (see foreachModifiedTile()).
+template <typename T, class Layout = RowMajorLayout, class Allocator = std::allocator<T>>
+class Matrix
 {
 public:
     using Size = Point2i;
-    
-    Matrix(int xSize_, int ySize_)
-        : xSize(xSize_), ySize(ySize_), data(static_cast<size_t>(xSize_ * ySize_))
+    using value_type = T;
+    using layout_type = Layout;
+
+    Matrix(int xSize_, int ySize_, const Allocator &allocator = Allocator())
+        : Matrix(Size {xSize_, ySize_}, allocator)
+    {
+    }
+    Matrix(const Size &size, const Allocator &allocator = Allocator())
+        : xSize(size.x), ySize(size.y), layout(size, sizeof(T)),
+          data(layout.storageSize(), allocator)
+    {
+    }
+
+    [[nodiscard]] auto at(int x, int y) -> T & { return at(Point2i {x, y}); }
+    [[nodiscard]] auto at(int x, int y) const -> const T & { return at(Point2i {x, y}); }
+    [[nodiscard]] auto at(const Point2i &p) -> T &
+    {
+        auto &value = data.at(checkedIndex(p));
+        revision.bump(p);
+        return value;
+    }
+    [[nodiscard]] auto at(const Point2i &p) const -> const T & { return data.at(checkedIndex(p)); }
+
+    // Unchecked access, for points known to be inside. Checked with assert() in debug builds.
+    [[nodiscard]] auto operator[](const Point2i &p) -> T &
+    {
+        assert(contains(p));
+        return data[index(p)];
+    }
+    [[nodiscard]] auto operator[](const Point2i &p) const -> const T &
+    {
+        assert(contains(p));
+        return data[index(p)];
+    }
+
+    // Contiguous values of row 'y', which must be inside (unchecked, like operator[])
+    [[nodiscard]] auto row(int y) -> std::span<T>
+        requires Layout::contiguousRows
     {
+        return paddedRow(y).first(static_cast<size_t>(xSize));
     }
-    Matrix(const Size &size)
-        : xSize(size.x), ySize(size.y), data(static_cast<size_t>(size.x * size.y))
+    [[nodiscard]] auto row(int y) const -> std::span<const T>
+        requires Layout::contiguousRows
     {
+        return paddedRow(y).first(static_cast<size_t>(xSize));
     }
 
-    [[nodiscard]] auto at(int x, int y) -> T & { return data.at(index(x, y)); }
-    [[nodiscard]] auto at(int x, int y) const -> const T & { return data.at(index(x, y)); }
-    [[nodiscard]] auto at(const Point2i &p) -> T & { return data.at(index(p)); }
-    [[nodiscard]] auto at(const Point2i &p) const -> const T & { return data.at(index(p)); }
+    // Row 'y' followed by its padding, rowStride() values in all. Padding is never read by Matrix
+    // itself, so kernels may process it along with the row and leave anything there.
+    [[nodiscard]] auto paddedRow(int y) -> std::span<T>
+        requires Layout::contiguousRows
+    {
+        assert(y >= 0 && y < ySize);
+        return {data.data() + index(0, y), layout.rowStride()};
+    }
+    [[nodiscard]] auto paddedRow(int y) const -> std::span<const T>
+        requires Layout::contiguousRows
+    {
+        assert(y >= 0 && y < ySize);
+        return {data.data() + index(0, y), layout.rowStride()};
+    }
+
+    [[nodiscard]] auto rowStride() const noexcept -> size_t
+        requires Layout::contiguousRows
+    {
+        return layout.rowStride();
+    }
 
     [[nodiscard]] auto getXSize() const noexcept -> int { return xSize; }
     [[nodiscard]] auto getYSize() const noexcept -> int { return ySize; }
     [[nodiscard]] auto getSize() const noexcept -> Size { return Size {xSize, ySize}; }
+    [[nodiscard]] auto getAllocator() const -> Allocator { return data.get_allocator(); }
+    [[nodiscard]] auto getRevision() const noexcept -> std::uint64_t { return revision.get(); }
+
+    auto markModified() noexcept -> void { revision.bump(); }
+
+    // Marks the rectangle of 'size' at 'origin' modified, clipped to the matrix
+    auto markModified(const Point2i &origin, const Size &size) noexcept -> void
+    {
+        revision.bump(origin, size);
+    }
+
+    // Records modifications in square tiles of 'tileSize', a power of two. Until then, any
+    // modification counts for the whole matrix. Throws std::invalid_argument for other sizes.
+    auto trackModifiedTiles(int tileSize = 64) -> void { revision.trackTiles(getSize(), tileSize); }
+
+    // 0 if modified tiles aren't tracked
+    [[nodiscard]] auto getModifiedTileSize() const noexcept -> int
+    {
+        return revision.getTileSize();
+    }
+
+    // Calls func(origin, size) for each tile modified since revision 'since' (see getRevision()),
+    // clipped to the matrix. Without tile tracking, the whole matrix is one tile.
+    template <typename F> auto foreachModifiedTile(std::uint64_t since, F func) const -> void
+    {
+        revision.foreachModifiedTile(since, {0, 0}, getSize(), func);
+    }
 
     [[nodiscard]] auto contains(const Point2i &p) const -> bool
     {
         return p.x >= 0 && p.x < xSize && p.y >= 0 && p.y < ySize;
     }
 
-    auto begin() { return data.begin(); }
-    auto end() { return data.end(); }
+    // Values in storage order, only for layouts without padding
+    auto begin()
+        requires Layout::dense
+    {
+        revision.bump();
+        return data.begin();
+    }
+    auto end()
+        requires Layout::dense
+    {
+        return data.end();
+    }
 
     template <typename F> auto foreachKey(F func) const -> const Matrix &
     {
-        int i = 0;
         for (auto y = 0; y < ySize; ++y) {
             for (auto x = 0; x < xSize; ++x) {
                 func(Point2i {x, y});
@@ -53,54 +329,60 @@ public:
 
     template <typename F> auto foreachValue(F func) -> Matrix &
     {
-        for (auto &i : data)
-            func(i);
+        revision.bump();
+
+        forEachIndex(0, ySize, [&](int, int, size_t i) {
+            func(data[i]);
+        });
 
         return *this;
     }
 
     template <typename F> auto foreachValue(F func) const -> const Matrix &
     {
-        for (const auto &i : data)
-            func(i);
+        forEachIndex(0, ySize, [&](int, int, size_t i) {
+            func(data[i]);
+        });
 
         return *this;
     }
 
     template <typename F> auto foreachKeyValue(F func) -> Matrix &
     {
-        int i = 0;
-        for (auto y = 0; y < ySize; ++y) {
-            for (auto x = 0; x < xSize; ++x) {
-                func(Point2i {x, y}, data[i++]);
-            }
-        }
+        revision.bump();
+
+        forEachIndex(0, ySize, [&](int x, int y, size_t i) {
+            func(Point2i {x, y}, data[i]);
+        });
 
         return *this;
     }
 
     template <typename F> auto foreachKeyValue(F func) const -> const Matrix &
     {
-        int i = 0;
-        for (auto y = 0; y < ySize; ++y) {
-            for (auto x = 0; x < xSize; ++x) {
-                func(Point2i {x, y}, data[i++]);
-            }
-        }
+        forEachIndex(0, ySize, [&](int x, int y, size_t i) {
+            func(Point2i {x, y}, data[i]);
+        });
 
         return *this;
     }
 
     template <typename F> auto transform(F func) -> Matrix &
     {
-        for (auto &i : data)
-            i = func(i);
+        revision.bump();
+
+        forEachIndex(0, ySize, [&](int, int, size_t i) {
+            data[i] = func(data[i]);
+        });
 
         return *this;
     }
 
     auto fill(const T &value) -> Matrix &
     {
+        revision.bump();
+
+        // padding included, it's never read
         for (auto &i : data)
             i = value;
 
@@ -109,55 +391,856 @@ public:
 
     template <class G> auto generate(G generator) -> Matrix &
     {
-        int i = 0;
-        for (auto y = 0; y < ySize; ++y) {
-            for (auto x = 0; x < xSize; ++x) {
-                data[i++] = generator(Point2i {x, y});
+        revision.bump();
+
+        forEachIndex(0, ySize, [&](int x, int y, size_t i) {
+            data[i] = generator(Point2i {x, y});
+        });
+
+        return *this;
+    }
+
+    // Parallel overloads, see ParallelPolicy for ordering guarantees
+
+    template <typename F>
+    auto foreachKey(const ParallelPolicy &policy, F func) const -> const Matrix &
+    {
+        parallelForRows(ySize, xSize, policy, [&](int yBegin, int yEnd) {
+            for (auto y = yBegin; y < yEnd; ++y) {
+                for (auto x = 0; x < xSize; ++x) {
+                    func(Point2i {x, y});
+                }
+            }
+        });
+
+        return *this;
+    }
+
+    template <typename F> auto foreachValue(const ParallelPolicy &policy, F func) -> Matrix &
+    {
+        revision.bump();
+
+        forEachIndex(policy, [&](int, int, size_t i) {
+            func(data[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F>
+    auto foreachValue(const ParallelPolicy &policy, F func) const -> const Matrix &
+    {
+        forEachIndex(policy, [&](int, int, size_t i) {
+            func(data[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F> auto foreachKeyValue(const ParallelPolicy &policy, F func) -> Matrix &
+    {
+        revision.bump();
+
+        forEachIndex(policy, [&](int x, int y, size_t i) {
+            func(Point2i {x, y}, data[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F>
+    auto foreachKeyValue(const ParallelPolicy &policy, F func) const -> const Matrix &
+    {
+        forEachIndex(policy, [&](int x, int y, size_t i) {
+            func(Point2i {x, y}, data[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F> auto transform(const ParallelPolicy &policy, F func) -> Matrix &
+    {
+        revision.bump();
+
+        forEachIndex(policy, [&](int, int, size_t i) {
+            data[i] = func(data[i]);
+        });
+
+        return *this;
+    }
+
+    auto fill(const ParallelPolicy &policy, const T &value) -> Matrix &
+    {
+        revision.bump();
+
+        forEachIndex(policy, [&](int, int, size_t i) {
+            data[i] = value;
+        });
+
+        return *this;
+    }
+
+    template <class G> auto generate(const ParallelPolicy &policy, G generator) -> Matrix &
+    {
+        revision.bump();
+
+        forEachIndex(policy, [&](int x, int y, size_t i) {
+            data[i] = generator(Point2i {x, y});
+        });
+
+        return *this;
+    }
+
+private:
+    template <typename, class> friend class MatrixView;
+
+    int                       xSize;
+    int                       ySize;
+    Layout                    layout;
+    std::vector<T, Allocator> data;
+    MatrixRevision            revision;
+
+    auto index(int x, int y) const -> size_t { return layout.index(x, y); }
+    auto index(const Point2i &p) const -> size_t { return layout.index(p.x, p.y); }
+
+    // Padded layouts have storage for some points outside the matrix, so at() can't rely on
+    // std::vector::at() alone
+    auto checkedIndex(const Point2i &p) const -> size_t
+    {
+        if constexpr (Layout::dense) {
+            return index(p);
+        } else {
+            return contains(p) ? index(p) : data.size();
+        }
+    }
+
+    // Calls func(x, y, index) for the points of rows [yBegin, yEnd), in row-major order
+    template <typename F> auto forEachIndex(int yBegin, int yEnd, F func) const -> void
+    {
+        for (auto y = yBegin; y < yEnd; ++y) {
+            if constexpr (Layout::contiguousRows) {
+                auto i = index(0, y);
+                for (auto x = 0; x < xSize; ++x)
+                    func(x, y, i++);
+            } else {
+                for (auto x = 0; x < xSize; ++x)
+                    func(x, y, index(x, y));
+            }
+        }
+    }
+
+    template <typename F> auto forEachIndex(const ParallelPolicy &policy, F func) const -> void
+    {
+        parallelForRows(ySize, xSize, policy, [&](int yBegin, int yEnd) {
+            forEachIndex(yBegin, yEnd, func);
+        });
+    }
+};
+
+// Non-owning window into a matrix: the rectangle of 'size' at 'origin'. A view has the interface of
+// Matrix in coordinates relative to its origin, and reads and writes the values of the matrix, so
+// algorithms can work on part of a map without copying it. Like std::span, views are cheap to copy
+// and const views may still write; MatrixView<const T> is read-only. Writes count as modifications
+// of the matrix (see Matrix::getRevision()). Views stay valid as long as the matrix exists and
+// keeps its size.
+template <typename T, class Layout = RowMajorLayout> class MatrixView
+{
+    using Revision = std::conditional_t<std::is_const_v<T>, const MatrixRevision, MatrixRevision>;
+
+public:
+    using Size = Point2i;
+    using value_type = std::remove_const_t<T>;
+    using layout_type = Layout;
+
+    template <class Allocator>
+    MatrixView(Matrix<value_type, Layout, Allocator> &m) : MatrixView(m, {0, 0}, m.getSize())
+    {
+    }
+    template <class Allocator>
+    MatrixView(const Matrix<value_type, Layout, Allocator> &m)
+        requires std::is_const_v<T>
+        : MatrixView(m, {0, 0}, m.getSize())
+    {
+    }
+
+    // The rectangle must be inside the matrix, or std::out_of_range is thrown
+    template <class Allocator>
+    MatrixView(Matrix<value_type, Layout, Allocator> &m, const Point2i &origin_, const Size &size_)
+        : MatrixView(m.data.data(), m.layout, m.revision, m.getSize(), origin_, size_)
+    {
+    }
+    template <class Allocator>
+    MatrixView(const Matrix<value_type, Layout, Allocator> &m, const Point2i &origin_,
+               const Size &size_)
+        requires std::is_const_v<T>
+        : MatrixView(m.data.data(), m.layout, m.revision, m.getSize(), origin_, size_)
+    {
+    }
+
+    // Read-only view of a writable one. A template, so it isn't taken for the copy constructor.
+    template <typename U>
+        requires(std::is_const_v<T> && std::same_as<U, value_type>)
+    MatrixView(const MatrixView<U, Layout> &other)
+        : data(other.data), layout(other.layout), origin(other.origin), size(other.size),
+          revision(other.revision)
+    {
+    }
+
+    // Part of this view, with 'origin_' relative to this view
+    [[nodiscard]] auto subview(const Point2i &origin_, const Size &size_) const -> MatrixView
+    {
+        return MatrixView(data, layout, *revision, size, origin_, size_, origin);
+    }
+
+    [[nodiscard]] auto at(int x, int y) const -> T & { return at(Point2i {x, y}); }
+    [[nodiscard]] auto at(const Point2i &p) const -> T &
+    {
+        if (!contains(p)) throw std::out_of_range("MatrixView::at");
+        if constexpr (!std::is_const_v<T>) revision->bump(origin + p);
+        return data[index(p)];
+    }
+
+    // Unchecked access, like Matrix::operator[]. Writes aren't tracked.
+    [[nodiscard]] auto operator[](const Point2i &p) const -> T &
+    {
+        assert(contains(p));
+        return data[index(p)];
+    }
+
+    [[nodiscard]] auto row(int y) const -> std::span<T>
+        requires Layout::contiguousRows
+    {
+        assert(y >= 0 && y < size.y);
+        return {data + index(0, y), static_cast<std::size_t>(size.x)};
+    }
+
+    // Distance between rows in elements, as in the matrix
+    [[nodiscard]] auto rowStride() const noexcept -> std::size_t
+        requires Layout::contiguousRows
+    {
+        return layout.rowStride();
+    }
+
+    [[nodiscard]] auto getXSize() const noexcept -> int { return size.x; }
+    [[nodiscard]] auto getYSize() const noexcept -> int { return size.y; }
+    [[nodiscard]] auto getSize() const noexcept -> Size { return size; }
+    [[nodiscard]] auto getOrigin() const noexcept -> Point2i { return origin; }
+    [[nodiscard]] auto getRevision() const noexcept -> std::uint64_t { return revision->get(); }
+
+    auto markModified() const noexcept -> void
+        requires(!std::is_const_v<T>)
+    {
+        revision->bump(origin, size);
+    }
+
+    // Marks the rectangle of 'size_' at 'origin_' modified, clipped to the view
+    auto markModified(const Point2i &origin_, const Size &size_) const noexcept -> void
+        requires(!std::is_const_v<T>)
+    {
+        const Point2i from {std::max(origin_.x, 0), std::max(origin_.y, 0)};
+        const Point2i to {std::min(origin_.x + size_.x, size.x),
+                          std::min(origin_.y + size_.y, size.y)};
+        if (from.x < to.x && from.y < to.y) revision->bump(origin + from, to - from);
+    }
+
+    [[nodiscard]] auto getModifiedTileSize() const noexcept -> int
+    {
+        return revision->getTileSize();
+    }
+
+    // Like Matrix::foreachModifiedTile(), for the tiles clipped to the view
+    template <typename F> auto foreachModifiedTile(std::uint64_t since, F func) const -> void
+    {
+        revision->foreachModifiedTile(since, origin, size, [&](const Point2i &o, const Size &s) {
+            func(o - origin, s);
+        });
+    }
+
+    [[nodiscard]] auto contains(const Point2i &p) const -> bool
+    {
+        return p.x >= 0 && p.x < size.x && p.y >= 0 && p.y < size.y;
+    }
+
+    template <typename F> auto foreachKey(F func) const -> const MatrixView &
+    {
+        for (auto y = 0; y < size.y; ++y) {
+            for (auto x = 0; x < size.x; ++x) {
+                func(Point2i {x, y});
             }
         }
 
         return *this;
     }
 
+    template <typename F> auto foreachValue(F func) const -> const MatrixView &
+    {
+        bump();
+        forEachIndex(0, size.y, [&](int, int, size_t i) {
+            func(data[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F> auto foreachKeyValue(F func) const -> const MatrixView &
+    {
+        bump();
+        forEachIndex(0, size.y, [&](int x, int y, size_t i) {
+            func(Point2i {x, y}, data[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F> auto transform(F func) const -> const MatrixView &
+        requires(!std::is_const_v<T>)
+    {
+        bump();
+        forEachIndex(0, size.y, [&](int, int, size_t i) {
+            data[i] = func(data[i]);
+        });
+
+        return *this;
+    }
+
+    auto fill(const value_type &value) const -> const MatrixView &
+        requires(!std::is_const_v<T>)
+    {
+        bump();
+        forEachIndex(0, size.y, [&](int, int, size_t i) {
+            data[i] = value;
+        });
+
+        return *this;
+    }
+
+    template <class G> auto generate(G generator) const -> const MatrixView &
+        requires(!std::is_const_v<T>)
+    {
+        bump();
+        forEachIndex(0, size.y, [&](int x, int y, size_t i) {
+            data[i] = generator(Point2i {x, y});
+        });
+
+        return *this;
+    }
+
+    // Parallel overloads, see ParallelPolicy for ordering guarantees
+
+    template <typename F>
+    auto foreachKey(const ParallelPolicy &policy, F func) const -> const MatrixView &
+    {
+        parallelForRows(size.y, size.x, policy, [&](int yBegin, int yEnd) {
+            for (auto y = yBegin; y < yEnd; ++y) {
+                for (auto x = 0; x < size.x; ++x) {
+                    func(Point2i {x, y});
+                }
+            }
+        });
+
+        return *this;
+    }
+
+    template <typename F>
+    auto foreachValue(const ParallelPolicy &policy, F func) const -> const MatrixView &
+    {
+        bump();
+        forEachIndex(policy, [&](int, int, size_t i) {
+            func(data[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F>
+    auto foreachKeyValue(const ParallelPolicy &policy, F func) const -> const MatrixView &
+    {
+        bump();
+        forEachIndex(policy, [&](int x, int y, size_t i) {
+            func(Point2i {x, y}, data[i]);
+        });
+
+        return *this;
+    }
+
+    template <typename F>
+    auto transform(const ParallelPolicy &policy, F func) const -> const MatrixView &
+        requires(!std::is_const_v<T>)
+    {
+        bump();
+        forEachIndex(policy, [&](int, int, size_t i) {
+            data[i] = func(data[i]);
+        });
+
+        return *this;
+    }
+
+    auto fill(const ParallelPolicy &policy, const value_type &value) const -> const MatrixView &
+        requires(!std::is_const_v<T>)
+    {
+        bump();
+        forEachIndex(policy, [&](int, int, size_t i) {
+            data[i] = value;
+        });
+
+        return *this;
+    }
+
+    template <class G>
+    auto generate(const ParallelPolicy &policy, G generator) const -> const MatrixView &
+        requires(!std::is_const_v<T>)
+    {
+        bump();
+        forEachIndex(policy, [&](int x, int y, size_t i) {
+            data[i] = generator(Point2i {x, y});
+        });
+
+        return *this;
+    }
+
 private:
-    int            xSize;
-    int            ySize;
-    std::vector<T> data;
+    template <typename, class> friend class MatrixView;
+
+    T        *data;
+    Layout    layout;
+    Point2i   origin; // in the matrix
+    Size      size;
+    Revision *revision;
+
+    // 'origin_' is relative to 'base', a point of a matrix of 'matrixSize'
+    MatrixView(T *data_, const Layout &layout_, Revision &revision_, const Size &parentSize,
+               const Point2i &origin_, const Size &size_, const Point2i &base = {0, 0})
+        : data(data_), layout(layout_), origin(base + origin_), size(size_), revision(&revision_)
+    {
+        if (!rectangleInside(parentSize, origin_, size_))
+            throw std::out_of_range("MatrixView outside the matrix");
+    }
+
+    auto index(int x, int y) const -> size_t { return layout.index(origin.x + x, origin.y + y); }
+    auto index(const Point2i &p) const -> size_t { return index(p.x, p.y); }
+
+    auto bump() const -> void
+    {
+        if constexpr (!std::is_const_v<T>) revision->bump(origin, size);
+    }
+
+    // Calls func(x, y, index) for the points of rows [yBegin, yEnd), in row-major order
+    template <typename F> auto forEachIndex(int yBegin, int yEnd, F func) const -> void
+    {
+        for (auto y = yBegin; y < yEnd; ++y) {
+            if constexpr (Layout::contiguousRows) {
+                auto i = index(0, y);
+                for (auto x = 0; x < size.x; ++x)
+                    func(x, y, i++);
+            } else {
+                for (auto x = 0; x < size.x; ++x)
+                    func(x, y, index(x, y));
+            }
+        }
+    }
 
-    auto index(int x, int y) const -> size_t { return static_cast<size_t>(y * xSize + x); }
-    auto index(const Point2i &p) const -> size_t { return static_cast<size_t>(p.y * xSize + p.x); }
+    template <typename F> auto forEachIndex(const ParallelPolicy &policy, F func) const -> void
+    {
+        parallelForRows(size.y, size.x, policy, [&](int yBegin, int yEnd) {
+            forEachIndex(yBegin, yEnd, func);
+        });
+    }
 };
 
-template <typename T> auto min(const Matrix<T> &m) -> T
+template <typename T, class Layout, class Allocator>
+MatrixView(Matrix<T, Layout, Allocator> &) -> MatrixView<T, Layout>;
+template <typename T, class Layout, class Allocator>
+MatrixView(const Matrix<T, Layout, Allocator> &) -> MatrixView<const T, Layout>;
+template <typename T, class Layout, class Allocator>
+MatrixView(Matrix<T, Layout, Allocator> &, const Point2i &, const Point2i &)
+    -> MatrixView<T, Layout>;
+template <typename T, class Layout, class Allocator>
+MatrixView(const Matrix<T, Layout, Allocator> &, const Point2i &, const Point2i &)
+    -> MatrixView<const T, Layout>;
+
+// Matrix or MatrixView
+template <class M>
+concept MatrixLike = requires(const M &m, const Point2i &p) {
+    typename M::value_type;
+    typename M::layout_type;
+    { m.getSize() } -> std::same_as<Point2i>;
+    { m.contains(p) } -> std::same_as<bool>;
+    m[p];
+};
+
+// Value type of a MatrixLike type, or of a reference to one
+template <class M> using MatrixValue = typename std::remove_cvref_t<M>::value_type;
+
+/* -------------------------------------------------------------------------- */
+
+// Allocator for elements of type U, from the same source as 'Allocator'
+template <class Allocator, typename U>
+using RebindAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<U>;
+
+/* -------------------------------------------------------------------------- */
+
+// Adds rows [yBegin, yEnd) of the rectangle at 'origin' to 'stats'
+template <MatrixLike M>
+auto accumulateRows(const M &m, const Point2i &origin, int width, int yBegin, int yEnd,
+                    StatisticsAccumulator<typename M::value_type> &stats) -> void
 {
-    T          ret = m.at({0, 0});
-    m.foreachValue([&](const T &v) {
-        ret = std::min(ret, v);
+    if (width == 0) return;
+
+    std::vector<typename M::value_type> buffer;
+    for (auto y = yBegin; y < yEnd; ++y) {
+        if constexpr (M::layout_type::contiguousRows) {
+            stats.add(m.row(origin.y + y).subspan(static_cast<std::size_t>(origin.x),
+                                                  static_cast<std::size_t>(width)));
+        } else {
+            buffer.clear();
+            for (auto x = origin.x; x < origin.x + width; ++x)
+                buffer.push_back(m[{x, origin.y + y}]);
+            stats.add(buffer);
+        }
+    }
+}
+
+// Statistics of the values in the rectangle of 'size' at 'origin', which must be inside the matrix,
+// in a single pass. A histogram over [min, max] (high <= low in 'bins') takes a second pass.
+template <MatrixLike M>
+auto statistics(const M &m, const Point2i &origin, const Point2i &size,
+                const HistogramBins &bins = {}) -> Statistics<typename M::value_type>
+{
+    using T = typename M::value_type;
+
+    if (!rectangleInside(m.getSize(), origin, size))
+        throw std::out_of_range("statistics: rectangle outside the matrix");
+
+    const auto fixedRange = bins.high > bins.low;
+
+    StatisticsAccumulator<T> stats(fixedRange ? bins : HistogramBins {});
+    accumulateRows(m, origin, size.x, 0, size.y, stats);
+    auto result = stats.result();
+
+    if (bins.bins > 0 && !fixedRange) {
+        const HistogramBins range {bins.bins, static_cast<double>(result.min),
+                                   static_cast<double>(result.max)};
+        StatisticsAccumulator<T> histogram(range);
+        accumulateRows(m, origin, size.x, 0, size.y, histogram);
+        result.histogram = histogram.result().histogram;
+    }
+
+    return result;
+}
+
+template <MatrixLike M>
+auto statistics(const M &m, const HistogramBins &bins = {}) -> Statistics<typename M::value_type>
+{
+    return statistics(m, {0, 0}, m.getSize(), bins);
+}
+
+// Parallel variants, over bands of rows. Results only depend on the matrix size, not on the number
+// of threads, but sums may differ from the serial variants in the last bits.
+template <MatrixLike M>
+auto statistics(const ParallelPolicy &policy, const M &m, const Point2i &origin,
+                const Point2i &size, const HistogramBins &bins = {})
+    -> Statistics<typename M::value_type>
+{
+    using T = typename M::value_type;
+
+    if (!rectangleInside(m.getSize(), origin, size))
+        throw std::out_of_range("statistics: rectangle outside the matrix");
+
+    const auto accumulate = [&](const HistogramBins &bandBins) {
+        std::mutex                                            mutex;
+        std::vector<std::pair<int, StatisticsAccumulator<T>>> bands;
+
+        parallelForRows(size.y, size.x, policy, [&](int yBegin, int yEnd) {
+            StatisticsAccumulator<T> band(bandBins);
+            accumulateRows(m, origin, size.x, yBegin, yEnd, band);
+
+            const std::lock_guard lock(mutex);
+            bands.emplace_back(yBegin, std::move(band));
+        });
+
+        // merged in row order, so the result doesn't depend on scheduling
+        std::sort(bands.begin(), bands.end(), [](const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+
+        StatisticsAccumulator<T> total(bandBins);
+        for (const auto &band : bands)
+            total.merge(band.second);
+        return total.result();
+    };
+
+    const auto fixedRange = bins.high > bins.low;
+
+    auto result = accumulate(fixedRange ? bins : HistogramBins {});
+    if (bins.bins > 0 && !fixedRange) {
+        result.histogram = accumulate({bins.bins, static_cast<double>(result.min),
+                                       static_cast<double>(result.max)})
+                               .histogram;
+    }
+
+    return result;
+}
+
+template <MatrixLike M>
+auto statistics(const ParallelPolicy &policy, const M &m, const HistogramBins &bins = {})
+    -> Statistics<typename M::value_type>
+{
+    return statistics(policy, m, {0, 0}, m.getSize(), bins);
+}
+
+template <MatrixLike M> auto min(const M &m) -> typename M::value_type
+{
+    using T = typename M::value_type;
+
+    if constexpr (std::is_arithmetic_v<T>) {
+        if (m.getXSize() == 0 || m.getYSize() == 0) throw std::out_of_range("min of empty matrix");
+        return statistics(m).min;
+    } else {
+        T ret = m.at({0, 0});
+        m.foreachValue([&](const T &v) {
+            ret = std::min(ret, v);
+        });
+        return ret;
+    }
+}
+
+template <MatrixLike M> auto max(const M &m) -> typename M::value_type
+{
+    using T = typename M::value_type;
+
+    if constexpr (std::is_arithmetic_v<T>) {
+        if (m.getXSize() == 0 || m.getYSize() == 0) throw std::out_of_range("max of empty matrix");
+        return statistics(m).max;
+    } else {
+        T ret = m.at({0, 0});
+        m.foreachValue([&](const T &v) {
+            ret = std::max(ret, v);
+        });
+        return ret;
+    }
+}
+
+// The map read by a long-lived computation: the view (or snapshot) it was given, or a view of the
+// matrix it was given, taken again by each update(). A matrix can then be assigned to between
+// updates, as long as it keeps its size and outlives the computation; update() throws
+// std::logic_error if it was resized. A view keeps reading the storage it was taken of.
+template <class Map> class MatrixSource
+{
+public:
+    template <class M>
+        requires std::convertible_to<const M &, Map>
+    MatrixSource(const M &map_) : map(map_)
+    {
+    }
+
+    template <typename T, class Layout, class Allocator>
+    MatrixSource(const Matrix<T, Layout, Allocator> &matrix_)
+        : map(matrix_), matrix(&matrix_), viewOf([](const void *m) {
+              return Map(*static_cast<const Matrix<T, Layout, Allocator> *>(m));
+          })
+    {
+    }
+
+    auto update() -> const Map &
+    {
+        if (matrix) {
+            const auto view = viewOf(matrix);
+            if (view.getSize() != map.getSize()) throw std::logic_error("map resized");
+            map = view;
+        }
+        return map;
+    }
+
+    // The map as of the last update()
+    [[nodiscard]] auto get() const noexcept -> const Map & { return map; }
+
+private:
+    Map         map;
+    const void *matrix {nullptr};
+    Map (*viewOf)(const void *) {nullptr};
+};
+
+// Statistics of a matrix or view, computed again only when the matrix has changed since the last
+// call (see Matrix::getRevision()). If the matrix tracks modified tiles, only the modified tiles
+// are read again, and the statistics of all tiles are merged; sums may then differ from
+// statistics() in the last bits. Histograms over [min, max] are always computed from scratch.
+// Map is the type that refers to the matrix, a view unless the matrix has its own (see
+// MatrixSnapshot), read through a MatrixSource. Not thread-safe.
+template <typename T, class Layout = RowMajorLayout, class Map = MatrixView<const T, Layout>>
+class CachedStatistics
+{
+public:
+    explicit CachedStatistics(MatrixSource<Map> source_, const HistogramBins &bins_ = {})
+        : source(source_), bins(bins_)
+    {
+    }
+
+    auto get() -> const Statistics<T> &
+    {
+        const auto &m = source.update();
+        const auto current = m.getRevision();
+        if (stats && revision == current) return *stats;
+
+        const auto tracked = m.getModifiedTileSize();
+        if (tracked == 0 || (bins.bins > 0 && !(bins.high > bins.low))) {
+            stats = statistics(m, bins);
+        } else {
+            if (!stats || tileSize != tracked) {
+                initTiles(tracked);
+            } else {
+                m.foreachModifiedTile(revision, [&](const Point2i &origin, const Point2i &size) {
+                    tiles[tileIndex(origin)] = accumulate(origin, size);
+                });
+            }
+
+            // merged in a fixed order, so results don't depend on which tiles were read again
+            StatisticsAccumulator<T> total(bins);
+            for (const auto &tile : tiles)
+                total.merge(tile);
+            stats = total.result();
+        }
+
+        revision = current;
+        return *stats;
+    }
+
+private:
+    MatrixSource<Map>            source;
+    HistogramBins                bins;
+    std::optional<Statistics<T>> stats;
+    std::uint64_t                revision {0};
+
+    // Statistics of the parts of the view in each tile of the matrix, row by row
+    std::vector<StatisticsAccumulator<T>> tiles;
+    int                                   tileSize {0};
+    Point2i                               firstTile;
+    int                                   xTiles {0};
+
+    auto accumulate(const Point2i &origin, const Point2i &size) const -> StatisticsAccumulator<T>
+    {
+        StatisticsAccumulator<T> acc(bins);
+        accumulateRows(source.get(), origin, size.x, 0, size.y, acc);
+        return acc;
+    }
+
+    auto mapOrigin() const -> Point2i
+    {
+        if constexpr (requires { source.get().getOrigin(); }) {
+            return source.get().getOrigin();
+        } else {
+            return {0, 0};
+        }
+    }
+
+    // Tile of the matrix holding 'p' of the view
+    auto tileIndex(const Point2i &p) const -> std::size_t
+    {
+        const auto q = mapOrigin() + p;
+        return static_cast<std::size_t>((q.y / tileSize - firstTile.y) * xTiles + q.x / tileSize -
+                                        firstTile.x);
+    }
+
+    auto initTiles(int tileSize_) -> void
+    {
+        tileSize = tileSize_;
+        tiles.clear();
+        const auto size = source.get().getSize();
+        if (size.x == 0 || size.y == 0) return;
+
+        const auto o = mapOrigin();
+        const auto end = o + size;
+        firstTile = {o.x / tileSize, o.y / tileSize};
+        xTiles = (end.x - 1) / tileSize - firstTile.x + 1;
+
+        for (auto ty = firstTile.y; ty * tileSize < end.y; ++ty) {
+            const auto y0 = std::max(o.y, ty * tileSize);
+            const auto y1 = std::min(end.y, (ty + 1) * tileSize);
+
+            for (auto tx = firstTile.x; tx < firstTile.x + xTiles; ++tx) {
+                const auto x0 = std::max(o.x, tx * tileSize);
+                const auto x1 = std::min(end.x, (tx + 1) * tileSize);
+                tiles.push_back(accumulate(Point2i {x0, y0} - o, {x1 - x0, y1 - y0}));
+            }
+        }
+    }
+};
+
+template <typename T, class Layout, class Allocator>
+CachedStatistics(const Matrix<T, Layout, Allocator> &) -> CachedStatistics<T, Layout>;
+template <typename T, class Layout, class Allocator>
+CachedStatistics(const Matrix<T, Layout, Allocator> &, const HistogramBins &)
+    -> CachedStatistics<T, Layout>;
+template <typename T, class Layout>
+CachedStatistics(MatrixView<T, Layout>) -> CachedStatistics<std::remove_const_t<T>, Layout>;
+template <typename T, class Layout>
+CachedStatistics(MatrixView<T, Layout>, const HistogramBins &)
+    -> CachedStatistics<std::remove_const_t<T>, Layout>;
+
+// Maps values of a matrix or writable view linearly from [min, max] to [low, high]. A constant
+// matrix is set to 'low'.
+template <class M>
+    requires MatrixLike<std::remove_cvref_t<M>> && std::floating_point<MatrixValue<M>>
+auto normalize(M &&m, MatrixValue<M> low = 0, MatrixValue<M> high = 1) -> void
+{
+    const auto stats = statistics(m);
+    const auto range = stats.max - stats.min;
+    const auto scale = range > 0 ? (high - low) / range : MatrixValue<M> {0};
+
+    m.transform([&](MatrixValue<M> v) {
+        return low + (v - stats.min) * scale;
     });
-    return ret;
 }
 
-template <typename T> auto max(const Matrix<T> &m) -> T
+template <class M>
+    requires MatrixLike<std::remove_cvref_t<M>> && std::floating_point<MatrixValue<M>>
+auto normalize(const ParallelPolicy &policy, M &&m, MatrixValue<M> low = 0,
+               MatrixValue<M> high = 1) -> void
 {
-    T          ret = m.at({0, 0});
-    m.foreachValue([&](const T &v) {
-        ret = std::max(ret, v);
+    const auto stats = statistics(policy, m);
+    const auto range = stats.max - stats.min;
+    const auto scale = range > 0 ? (high - low) / range : MatrixValue<M> {0};
+
+    m.transform(policy, [&](MatrixValue<M> v) {
+        return low + (v - stats.min) * scale;
     });
-    return ret;
 }
 
-template <typename A, typename B, class F>
-auto transformMatrix(const Matrix<A> &src, F func) -> Matrix<B>
+/* -------------------------------------------------------------------------- */
+
+template <typename A, typename B, class F, class Layout, class Allocator>
+auto transformMatrix(const Matrix<A, Layout, Allocator> &src, F func)
+    -> Matrix<B, Layout, RebindAllocator<Allocator, B>>
 {
-    Matrix<B> out(src.getSize());
+    Matrix<B, Layout, RebindAllocator<Allocator, B>> out(src.getSize(), src.getAllocator());
     for (auto y = 0; y < src.getYSize(); ++y) {
         for (auto x = 0; x < src.getXSize(); ++x) {
-            out.at(x, y) = func(src.at(x, y));
+            const Point2i p {x, y};
+            out[p] = func(src[p]);
         }
     }
     return out;
 }
 
+template <typename A, typename B, class F, class Layout, class Allocator>
+auto transformMatrix(const ParallelPolicy &policy, const Matrix<A, Layout, Allocator> &src, F func)
+    -> Matrix<B, Layout, RebindAllocator<Allocator, B>>
+{
+    Matrix<B, Layout, RebindAllocator<Allocator, B>> out(src.getSize(), src.getAllocator());
+    parallelForRows(src.getYSize(), src.getXSize(), policy, [&](int yBegin, int yEnd) {
+        for (auto y = yBegin; y < yEnd; ++y) {
+            for (auto x = 0; x < src.getXSize(); ++x) {
+                const Point2i p {x, y};
+                out[p] = func(src[p]);
+            }
+        }
+    });
+    return out;
+}
+
+// Matrix with rows padded and aligned to Alignment bytes, for aligned SIMD over whole rows
+template <typename T, std::size_t Alignment = 64>
+using AlignedMatrix = Matrix<T, PaddedRowLayout<Alignment>, AlignedAllocator<T, Alignment>>;
+
 } // namespace mist
 
 #endif
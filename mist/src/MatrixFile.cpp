@@ -0,0 +1,175 @@
+#include "MatrixFile.h"
+
+#include <limits>
+#include <optional>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mist
+{
+
+namespace
+{
+
+constexpr std::array<char, 8> magic {'M', 'I', 'S', 'T', 'M', 'A', 'T', '\0'};
+constexpr std::uint32_t       currentVersion = 1;
+constexpr std::uint32_t       byteOrderMark = 0x01020304;
+
+auto elementSize(MatrixElementType type) -> std::size_t
+{
+    switch (type) {
+    case MatrixElementType::Int8:
+    case MatrixElementType::UInt8: return 1;
+    case MatrixElementType::Int16:
+    case MatrixElementType::UInt16: return 2;
+    case MatrixElementType::Int32:
+    case MatrixElementType::UInt32:
+    case MatrixElementType::Float32: return 4;
+    case MatrixElementType::Int64:
+    case MatrixElementType::UInt64:
+    case MatrixElementType::Float64: return 8;
+    }
+    return 0;
+}
+
+// a * b, or nothing if it doesn't fit
+auto checkedProduct(std::uintmax_t a, std::uintmax_t b) -> std::optional<std::uintmax_t>
+{
+    if (b != 0 && a > std::numeric_limits<std::uintmax_t>::max() / b) return std::nullopt;
+    return a * b;
+}
+
+} // namespace
+
+auto makeMatrixFileHeader(MatrixElementType type, std::uint32_t components, const Point2i &size)
+    -> MatrixFileHeader
+{
+    if (size.x < 0 || size.y < 0) throw MatrixFileError("Negative matrix size");
+
+    MatrixFileHeader header {};
+    header.magic = magic;
+    header.version = currentVersion;
+    header.byteOrder = byteOrderMark;
+    header.elementType = type;
+    header.components = components;
+    header.xSize = size.x;
+    header.ySize = size.y;
+    header.dataOffset = matrixFileDataOffset;
+    return header;
+}
+
+auto checkMatrixFileHeader(const MatrixFileHeader &header, MatrixElementType type,
+                           std::uint32_t components, std::uintmax_t fileSize) -> Point2i
+{
+    if (header.magic != magic) throw MatrixFileError("Not a matrix file");
+    if (header.version > currentVersion)
+        throw MatrixFileError("Matrix file version " + std::to_string(header.version) +
+                              " is newer than supported");
+    if (header.byteOrder != byteOrderMark)
+        throw MatrixFileError("Matrix file was written with a different byte order");
+    if (header.elementType != type || header.components != components)
+        throw MatrixFileError("Matrix file holds a different element type");
+    if (header.xSize < 0 || header.ySize < 0) throw MatrixFileError("Corrupt matrix file size");
+    if (header.dataOffset < sizeof(MatrixFileHeader) || header.dataOffset % elementSize(type) != 0)
+        throw MatrixFileError("Corrupt matrix file data offset");
+
+    // sizes from a corrupt header may not even fit in a file size
+    std::optional<std::uintmax_t> dataSize = static_cast<std::uintmax_t>(header.xSize);
+    for (const auto factor : {static_cast<std::uintmax_t>(header.ySize),
+                              std::uintmax_t {components}, std::uintmax_t {elementSize(type)}}) {
+        if (dataSize) dataSize = checkedProduct(*dataSize, factor);
+    }
+    if (!dataSize) throw MatrixFileError("Corrupt matrix file size");
+
+    if (fileSize != 0 && (header.dataOffset > fileSize || *dataSize > fileSize - header.dataOffset))
+        throw MatrixFileError("Matrix file is truncated");
+
+    return {header.xSize, header.ySize};
+}
+
+/* -------------------------------------------------------------------------- */
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path &path)
+{
+    const auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw MatrixFileError("Can't open " + path.string());
+
+    LARGE_INTEGER fileSize {};
+    GetFileSizeEx(file, &fileSize);
+    length = static_cast<std::size_t>(fileSize.QuadPart);
+
+    if (length > 0) {
+        const auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            const auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            address = static_cast<const std::byte *>(view);
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+
+    if (length > 0 && !address) throw MatrixFileError("Can't map " + path.string());
+}
+
+auto MappedFile::unmap() noexcept -> void
+{
+    if (address) UnmapViewOfFile(address);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path &path)
+{
+    const auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw MatrixFileError("Can't open " + path.string());
+
+    struct stat info {};
+    if (::fstat(fd, &info) == 0) length = static_cast<std::size_t>(info.st_size);
+
+    if (length > 0) {
+        void *p = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) address = static_cast<const std::byte *>(p);
+    }
+    ::close(fd);
+
+    if (length > 0 && !address) throw MatrixFileError("Can't map " + path.string());
+}
+
+auto MappedFile::unmap() noexcept -> void
+{
+    if (address) ::munmap(const_cast<std::byte *>(address), length);
+}
+
+#endif
+
+MappedFile::~MappedFile() { unmap(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : address(std::exchange(other.address, nullptr)), length(std::exchange(other.length, 0))
+{
+}
+
+auto MappedFile::operator=(MappedFile &&other) noexcept -> MappedFile &
+{
+    if (this != &other) {
+        unmap();
+        address = std::exchange(other.address, nullptr);
+        length = std::exchange(other.length, 0);
+    }
+    return *this;
+}
+
+} // namespace mist
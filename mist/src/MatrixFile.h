@@ -0,0 +1,363 @@
+#ifndef MATRIXFILE_H_
+#define MATRIXFILE_H_
+
+#include "Matrix.h"
+#include "Point.h"
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mist
+{
+
+// Binary container for matrices of numbers or Point2 of numbers: a 64-byte MatrixFileHeader
+// followed by the values in row-major order, in the byte order of the machine that wrote them.
+// Files are read back only on machines with the same byte order. Values start 64 bytes into the
+// file, so a memory-mapped file can be used in place (see MappedMatrix).
+
+enum class MatrixElementType : std::uint32_t {
+    Int8 = 1,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Int64,
+    UInt64,
+    Float32,
+    Float64
+};
+
+struct MatrixFileHeader {
+    std::array<char, 8>  magic;
+    std::uint32_t        version;
+    std::uint32_t        byteOrder;
+    MatrixElementType    elementType;
+    std::uint32_t        components; // 1 for numbers, 2 for Point2
+    std::int32_t         xSize;
+    std::int32_t         ySize;
+    std::uint64_t        dataOffset;
+    std::array<char, 24> reserved;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 64);
+
+// Where the values start in files written by this version
+inline constexpr std::uint64_t matrixFileDataOffset = sizeof(MatrixFileHeader);
+
+class MatrixFileError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// How values of T are described in the header. Point2<T> is stored as x, y pairs.
+template <typename T> struct MatrixFileElement {
+    static_assert(std::is_arithmetic_v<T>, "Matrix files hold numbers or Point2 of numbers");
+
+    static constexpr std::uint32_t components = 1;
+
+    static constexpr auto type() -> MatrixElementType
+    {
+        using enum MatrixElementType;
+
+        if constexpr (std::is_floating_point_v<T>) {
+            static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+            return sizeof(T) == 4 ? Float32 : Float64;
+        } else if constexpr (std::is_signed_v<T>) {
+            constexpr std::array types {Int8, Int16, Int32, Int64};
+            return types[std::bit_width(sizeof(T)) - 1];
+        } else {
+            constexpr std::array types {UInt8, UInt16, UInt32, UInt64};
+            return types[std::bit_width(sizeof(T)) - 1];
+        }
+    }
+};
+
+template <typename T> struct MatrixFileElement<Point2<T>> {
+    static_assert(sizeof(Point2<T>) == 2 * sizeof(T));
+
+    static constexpr std::uint32_t components = 2;
+    static constexpr auto type() -> MatrixElementType { return MatrixFileElement<T>::type(); }
+};
+
+auto makeMatrixFileHeader(MatrixElementType type, std::uint32_t components, const Point2i &size)
+    -> MatrixFileHeader;
+
+// Checks that a file with 'header' holds values of the given type and is at least 'fileSize'
+// bytes long (if not 0), and returns the matrix size. Throws MatrixFileError otherwise.
+auto checkMatrixFileHeader(const MatrixFileHeader &header, MatrixElementType type,
+                           std::uint32_t components, std::uintmax_t fileSize) -> Point2i;
+
+template <typename T> auto makeMatrixFileHeader(const Point2i &size) -> MatrixFileHeader
+{
+    using Element = MatrixFileElement<T>;
+    return makeMatrixFileHeader(Element::type(), Element::components, size);
+}
+
+template <typename T>
+auto checkMatrixFileHeader(const MatrixFileHeader &header, std::uintmax_t fileSize) -> Point2i
+{
+    using Element = MatrixFileElement<T>;
+    return checkMatrixFileHeader(header, Element::type(), Element::components, fileSize);
+}
+
+/* -------------------------------------------------------------------------- */
+
+template <typename T, class Layout, class Allocator>
+auto saveMatrix(const std::filesystem::path &path, const Matrix<T, Layout, Allocator> &m) -> void
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) throw MatrixFileError("Can't create " + path.string());
+
+    const auto header = makeMatrixFileHeader<T>(m.getSize());
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<T> buffer;
+    for (auto y = 0; y < m.getYSize(); ++y) {
+        std::span<const T> row;
+        if constexpr (Layout::contiguousRows) {
+            row = m.row(y);
+        } else {
+            buffer.resize(static_cast<std::size_t>(m.getXSize()));
+            for (auto x = 0; x < m.getXSize(); ++x)
+                buffer[static_cast<std::size_t>(x)] = m[{x, y}];
+            row = buffer;
+        }
+
+        file.write(reinterpret_cast<const char *>(row.data()),
+                   static_cast<std::streamsize>(row.size_bytes()));
+    }
+
+    if (!file) throw MatrixFileError("Error writing " + path.string());
+}
+
+template <typename T, class Layout = RowMajorLayout, class Allocator = std::allocator<T>>
+auto loadMatrix(const std::filesystem::path &path) -> Matrix<T, Layout, Allocator>
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw MatrixFileError("Can't open " + path.string());
+
+    MatrixFileHeader header {};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file) throw MatrixFileError(path.string() + " is not a matrix file");
+
+    const auto size = checkMatrixFileHeader<T>(header, std::filesystem::file_size(path));
+    file.seekg(static_cast<std::streamoff>(header.dataOffset));
+
+    Matrix<T, Layout, Allocator> m(size);
+    std::vector<T>               buffer(static_cast<std::size_t>(size.x));
+
+    for (auto y = 0; y < size.y; ++y) {
+        const auto row = [&] {
+            if constexpr (Layout::contiguousRows) {
+                return m.row(y);
+            } else {
+                return std::span<T>(buffer);
+            }
+        }();
+
+        file.read(reinterpret_cast<char *>(row.data()),
+                  static_cast<std::streamsize>(row.size_bytes()));
+
+        if constexpr (!Layout::contiguousRows) {
+            for (auto x = 0; x < size.x; ++x)
+                m[{x, y}] = buffer[static_cast<std::size_t>(x)];
+        }
+    }
+
+    if (!file) throw MatrixFileError("Error reading " + path.string());
+    return m;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    auto operator=(const MappedFile &) -> MappedFile & = delete;
+    auto operator=(MappedFile &&other) noexcept -> MappedFile &;
+
+    [[nodiscard]] auto data() const noexcept -> const std::byte * { return address; }
+    [[nodiscard]] auto size() const noexcept -> std::size_t { return length; }
+
+private:
+    const std::byte *address {nullptr};
+    std::size_t      length {0};
+
+    auto unmap() noexcept -> void;
+};
+
+// Read-only matrix backed by a memory-mapped matrix file. Opening only reads the header; pages
+// are loaded by the OS on first access and shared between processes mapping the same file.
+template <typename T> class MappedMatrix
+{
+public:
+    using Size = Point2i;
+
+    explicit MappedMatrix(const std::filesystem::path &path) : file(path)
+    {
+        if (file.size() < sizeof(MatrixFileHeader))
+            throw MatrixFileError(path.string() + " is not a matrix file");
+
+        MatrixFileHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        const auto size = checkMatrixFileHeader<T>(header, file.size());
+        xSize = size.x;
+        ySize = size.y;
+        values = reinterpret_cast<const T *>(file.data() + header.dataOffset);
+    }
+
+    [[nodiscard]] auto at(int x, int y) const -> const T & { return at(Point2i {x, y}); }
+    [[nodiscard]] auto at(const Point2i &p) const -> const T &
+    {
+        if (!contains(p)) throw std::out_of_range("MappedMatrix::at");
+        return (*this)[p];
+    }
+
+    // Unchecked access, for points known to be inside
+    [[nodiscard]] auto operator[](const Point2i &p) const -> const T &
+    {
+        assert(contains(p));
+        return values[static_cast<std::size_t>(p.y) * static_cast<std::size_t>(xSize) +
+                      static_cast<std::size_t>(p.x)];
+    }
+
+    [[nodiscard]] auto row(int y) const -> std::span<const T>
+    {
+        assert(y >= 0 && y < ySize);
+        const auto n = static_cast<std::size_t>(xSize);
+        return {values + static_cast<std::size_t>(y) * n, n};
+    }
+
+    [[nodiscard]] auto getXSize() const noexcept -> int { return xSize; }
+    [[nodiscard]] auto getYSize() const noexcept -> int { return ySize; }
+    [[nodiscard]] auto getSize() const noexcept -> Size { return Size {xSize, ySize}; }
+
+    [[nodiscard]] auto contains(const Point2i &p) const -> bool
+    {
+        return p.x >= 0 && p.x < xSize && p.y >= 0 && p.y < ySize;
+    }
+
+    template <typename F> auto foreachKeyValue(F func) const -> const MappedMatrix &
+    {
+        for (auto y = 0; y < ySize; ++y) {
+            const auto rowValues = row(y);
+            for (auto x = 0; x < xSize; ++x) {
+                func(Point2i {x, y}, rowValues[static_cast<std::size_t>(x)]);
+            }
+        }
+
+        return *this;
+    }
+
+private:
+    MappedFile file;
+    int        xSize {0};
+    int        ySize {0};
+    const T   *values {nullptr};
+};
+
+/* -------------------------------------------------------------------------- */
+
+// Writes a matrix file tile by tile, for matrices too large to hold in memory, e.g. from the sink
+// of NoiseStreamBuilder2. The file is created at full size up front; parts no tile covers read
+// back as zeros. writeTile() may be called concurrently.
+template <typename T> class MatrixFileWriter
+{
+public:
+    using Size = Point2i;
+
+    MatrixFileWriter(const std::filesystem::path &path_, const Size &size_)
+        : path(path_), size(size_)
+    {
+        const auto header = makeMatrixFileHeader<T>(size);
+
+        {
+            std::ofstream create(path, std::ios::binary | std::ios::trunc);
+            create.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            if (!create) throw MatrixFileError("Can't create " + path.string());
+        }
+
+        const auto numValues =
+            static_cast<std::uintmax_t>(size.x) * static_cast<std::uintmax_t>(size.y);
+        std::filesystem::resize_file(path, matrixFileDataOffset + numValues * sizeof(T));
+
+        file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file) throw MatrixFileError("Can't open " + path.string());
+    }
+
+    // Writes 'tile' with its top left value at 'origin'. The tile must lie inside the matrix.
+    template <class Layout, class Allocator>
+    auto writeTile(const Point2i &origin, const Matrix<T, Layout, Allocator> &tile) -> void
+    {
+        const Point2i last = origin + tile.getSize() - Point2i {1, 1};
+        if (origin.x < 0 || origin.y < 0 || last.x >= size.x || last.y >= size.y)
+            throw std::out_of_range("MatrixFileWriter::writeTile");
+
+        std::vector<T> buffer;
+        if constexpr (!Layout::contiguousRows)
+            buffer.resize(static_cast<std::size_t>(tile.getXSize()));
+
+        const std::lock_guard lock(mutex);
+
+        for (auto y = 0; y < tile.getYSize(); ++y) {
+            std::span<const T> row;
+            if constexpr (Layout::contiguousRows) {
+                row = tile.row(y);
+            } else {
+                for (auto x = 0; x < tile.getXSize(); ++x)
+                    buffer[static_cast<std::size_t>(x)] = tile[{x, y}];
+                row = buffer;
+            }
+
+            const auto index = static_cast<std::uintmax_t>(origin.y + y) *
+                                   static_cast<std::uintmax_t>(size.x) +
+                               static_cast<std::uintmax_t>(origin.x);
+            const auto offset = matrixFileDataOffset + index * sizeof(T);
+
+            file.seekp(static_cast<std::streamoff>(offset));
+            file.write(reinterpret_cast<const char *>(row.data()),
+                       static_cast<std::streamsize>(row.size_bytes()));
+        }
+
+        if (!file) throw MatrixFileError("Error writing " + path.string());
+    }
+
+    // Flushes everything written so far; the file is complete once the writer is destroyed
+    auto flush() -> void
+    {
+        const std::lock_guard lock(mutex);
+        file.flush();
+        if (!file) throw MatrixFileError("Error writing " + path.string());
+    }
+
+private:
+    std::filesystem::path path;
+    Size                  size;
+    std::fstream          file;
+    std::mutex            mutex;
+};
+
+} // namespace mist
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef MATRIXLAYOUT_H_
+#define MATRIXLAYOUT_H_
+
+#include "Point.h"
+
+#include <cstddef>
+#include <numeric>
+
+namespace mist
+{
+
+// Storage layouts for Matrix, mapping each point inside the matrix to an index into its storage.
+// Layouts are built from the matrix size and the size of its elements in bytes. Layouts with
+// contiguousRows store each row in consecutive elements, starting rowStride() elements apart, so
+// rows can be viewed as spans. Dense layouts also have no padding.
+
+// One row after another
+class RowMajorLayout
+{
+public:
+    static constexpr bool dense = true;
+    static constexpr bool contiguousRows = true;
+
+    RowMajorLayout(const Point2i &size, std::size_t) : xSize(size.x), ySize(size.y) {}
+
+    [[nodiscard]] auto index(int x, int y) const noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(y * xSize + x);
+    }
+
+    [[nodiscard]] auto storageSize() const noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(xSize * ySize);
+    }
+
+    [[nodiscard]] auto rowStride() const noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(xSize);
+    }
+
+private:
+    int xSize;
+    int ySize;
+};
+
+/* -------------------------------------------------------------------------- */
+
+// Rows padded to a multiple of RowAlignment bytes. With storage aligned to RowAlignment too (see
+// AlignedMatrix), every row starts aligned and can be processed with aligned SIMD, padding
+// included, without a scalar tail.
+template <std::size_t RowAlignment = 64> class PaddedRowLayout
+{
+    static_assert(RowAlignment > 0 && (RowAlignment & (RowAlignment - 1)) == 0);
+
+public:
+    static constexpr bool dense = false;
+    static constexpr bool contiguousRows = true;
+
+    PaddedRowLayout(const Point2i &size, std::size_t elementSize)
+        : stride(paddedRowSize(size.x, elementSize)), ySize(static_cast<std::size_t>(size.y))
+    {
+    }
+
+    [[nodiscard]] auto index(int x, int y) const noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(y) * stride + static_cast<std::size_t>(x);
+    }
+
+    [[nodiscard]] auto storageSize() const noexcept -> std::size_t { return ySize * stride; }
+    [[nodiscard]] auto rowStride() const noexcept -> std::size_t { return stride; }
+
+private:
+    std::size_t stride;
+    std::size_t ySize;
+
+    // Smallest number of elements >= xSize that fills a whole number of RowAlignment blocks
+    static auto paddedRowSize(int xSize, std::size_t elementSize) -> std::size_t
+    {
+        const auto step = RowAlignment / std::gcd(RowAlignment, elementSize);
+        return (static_cast<std::size_t>(xSize) + step - 1) / step * step;
+    }
+};
+
+/* -------------------------------------------------------------------------- */
+
+// Square tiles stored one after another, padded to whole tiles. Within a tile, points are stored
+// row by row, so vertical neighbors are TileSize elements apart instead of a whole map row.
+template <int TileSize = 64> class TiledLayout
+{
+    static_assert(TileSize > 0 && (TileSize & (TileSize - 1)) == 0);
+
+public:
+    static constexpr bool dense = false;
+    static constexpr bool contiguousRows = false;
+
+    TiledLayout(const Point2i &size, std::size_t)
+        : xTiles(tilesFor(size.x)), yTiles(tilesFor(size.y))
+    {
+    }
+
+    [[nodiscard]] auto index(int x, int y) const noexcept -> std::size_t
+    {
+        const auto ux = static_cast<std::size_t>(x);
+        const auto uy = static_cast<std::size_t>(y);
+        const auto tile = uy / TileSize * xTiles + ux / TileSize;
+        return tile * tileArea + uy % TileSize * TileSize + ux % TileSize;
+    }
+
+    [[nodiscard]] auto storageSize() const noexcept -> std::size_t
+    {
+        return xTiles * yTiles * tileArea;
+    }
+
+private:
+    static constexpr std::size_t tileArea = TileSize * TileSize;
+
+    std::size_t xTiles;
+    std::size_t yTiles;
+
+    static auto tilesFor(int size) -> std::size_t
+    {
+        return static_cast<std::size_t>((size + TileSize - 1) / TileSize);
+    }
+};
+
+/* -------------------------------------------------------------------------- */
+
+// Tiles like TiledLayout, with the points of each tile in Z-order (Morton order): points close to
+// each other in any direction are close in memory.
+template <int TileSize = 64> class MortonLayout
+{
+    static_assert(TileSize > 0 && TileSize <= 256 && (TileSize & (TileSize - 1)) == 0);
+
+public:
+    static constexpr bool dense = false;
+    static constexpr bool contiguousRows = false;
+
+    MortonLayout(const Point2i &size, std::size_t elementSize) : tiles(size, elementSize) {}
+
+    [[nodiscard]] auto index(int x, int y) const noexcept -> std::size_t
+    {
+        const auto ux = static_cast<unsigned>(x);
+        const auto uy = static_cast<unsigned>(y);
+        const auto tileStart = tiles.index(x & ~(TileSize - 1), y & ~(TileSize - 1));
+        return tileStart + (spreadBits(ux % TileSize) | spreadBits(uy % TileSize) << 1);
+    }
+
+    [[nodiscard]] auto storageSize() const noexcept -> std::size_t { return tiles.storageSize(); }
+
+private:
+    TiledLayout<TileSize> tiles;
+
+    // Moves bit i of an 8-bit value to bit 2i
+    static constexpr auto spreadBits(unsigned v) -> unsigned
+    {
+        v = (v | v << 4) & 0x0f0fu;
+        v = (v | v << 2) & 0x3333u;
+        v = (v | v << 1) & 0x5555u;
+        return v;
+    }
+};
+
+} // namespace mist
+
+#endif
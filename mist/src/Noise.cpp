@@ -2,53 +2,427 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdint>
 #include <random>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MIST_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
 using namespace mist;
 
 namespace mist
 {
 
-static constexpr std::array<int, 512> makeDefaultPermutation()
+// Permutation used by default-constructed generators
+static constexpr std::array<std::uint8_t, 256> defaultPermutation = {
+    126, 181, 219, 33,  162, 64,  103, 206, 223, 161, 231, 30,  32,  230, 229, 154, 186, 194, 168,
+    61,  14,  44,  239, 41,  139, 195, 245, 145, 53,  157, 5,   122, 228, 35,  39,  227, 201, 135,
+    177, 232, 156, 63,  192, 75,  12,  49,  71,  165, 222, 153, 151, 243, 110, 166, 131, 46,  72,
+    167, 159, 209, 176, 149, 216, 204, 196, 146, 190, 136, 164, 124, 212, 111, 60,  86,  120, 202,
+    79,  7,   15,  172, 140, 93,  101, 36,  123, 185, 42,  34,  224, 104, 16,  138, 85,  125, 56,
+    94,  244, 191, 95,  187, 23,  137, 67,  214, 77,  150, 213, 11,  117, 99,  78,  43,  105, 58,
+    80,  89,  22,  197, 107, 47,  148, 179, 116, 96,  253, 128, 199, 203, 0,   121, 234, 171, 40,
+    248, 218, 252, 163, 25,  160, 52,  3,   237, 90,  200, 155, 147, 38,  48,  221, 240, 254, 113,
+    59,  68,  10,  28,  129, 81,  205, 70,  31,  193, 109, 169, 143, 178, 51,  133, 1,   69,  249,
+    182, 45,  8,   130, 215, 127, 50,  173, 142, 88,  114, 112, 20,  132, 236, 66,  74,  87,  26,
+    82,  18,  207, 100, 13,  233, 54,  65,  73,  198, 118, 174, 37,  102, 97,  115, 19,  255, 62,
+    235, 76,  189, 108, 98,  180, 27,  83,  21,  152, 170, 175, 247, 2,   119, 246, 6,   17,  144,
+    241, 84,  217, 9,   226, 134, 251, 183, 106, 158, 92,  238, 250, 24,  141, 57,  208, 225, 188,
+    55,  29,  4,   211, 184, 210, 91,  220, 242};
+
+PerlinPermutation::PerlinPermutation()
 {
-    std::array<int, 512> ret = {
-        126, 181, 219, 33,  162, 64,  103, 206, 223, 161, 231, 30,  32,  230, 229, 154, 186, 194,
-        168, 61,  14,  44,  239, 41,  139, 195, 245, 145, 53,  157, 5,   122, 228, 35,  39,  227,
-        201, 135, 177, 232, 156, 63,  192, 75,  12,  49,  71,  165, 222, 153, 151, 243, 110, 166,
-        131, 46,  72,  167, 159, 209, 176, 149, 216, 204, 196, 146, 190, 136, 164, 124, 212, 111,
-        60,  86,  120, 202, 79,  7,   15,  172, 140, 93,  101, 36,  123, 185, 42,  34,  224, 104,
-        16,  138, 85,  125, 56,  94,  244, 191, 95,  187, 23,  137, 67,  214, 77,  150, 213, 11,
-        117, 99,  78,  43,  105, 58,  80,  89,  22,  197, 107, 47,  148, 179, 116, 96,  253, 128,
-        199, 203, 0,   121, 234, 171, 40,  248, 218, 252, 163, 25,  160, 52,  3,   237, 90,  200,
-        155, 147, 38,  48,  221, 240, 254, 113, 59,  68,  10,  28,  129, 81,  205, 70,  31,  193,
-        109, 169, 143, 178, 51,  133, 1,   69,  249, 182, 45,  8,   130, 215, 127, 50,  173, 142,
-        88,  114, 112, 20,  132, 236, 66,  74,  87,  26,  82,  18,  207, 100, 13,  233, 54,  65,
-        73,  198, 118, 174, 37,  102, 97,  115, 19,  255, 62,  235, 76,  189, 108, 98,  180, 27,
-        83,  21,  152, 170, 175, 247, 2,   119, 246, 6,   17,  144, 241, 84,  217, 9,   226, 134,
-        251, 183, 106, 158, 92,  238, 250, 24,  141, 57,  208, 225, 188, 55,  29,  4,   211, 184,
-        210, 91,  220, 242};
+    std::copy(defaultPermutation.begin(), defaultPermutation.end(), table.begin());
+    std::copy_n(table.data(), 256, table.data() + 256);
+}
 
-    std::copy_n(ret.data(), 256, ret.data() + 256);
+PerlinPermutation::PerlinPermutation(long seed)
+{
+    std::default_random_engine rng {static_cast<long unsigned int>(seed)};
 
-    return ret;
+    for (int i = 0; i < 256; ++i)
+        table[static_cast<std::size_t>(i)] = static_cast<std::uint8_t>(i);
+
+    std::shuffle(table.begin(), table.begin() + 256, rng);
+    std::copy_n(table.data(), 256, table.data() + 256);
 }
 
-static std::array<int, 512> pee = makeDefaultPermutation();
+/* -------------------------------------------------------------------------- */
+
+#ifdef MIST_X86_SIMD
+
+// Each ops struct wraps the intrinsics for one vector type:
+//   V - coordinates
+//   I - hashes, 32-bit lanes
+//   W - hashes widened to lanes as wide as V's, for masking V
 
-auto setPerlinSeed(long seed) -> void
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+namespace sse41
 {
-    std::default_random_engine rng {static_cast<long unsigned int>(seed)};
 
-    for (int i = 0; i < 256; ++i)
-        pee[i] = i;
+struct Ops2d {
+    using Scalar = double;
+    using V = __m128d;
+    using I = __m128i; // only the low two lanes are used
+    using W = __m128i;
+
+    static constexpr std::size_t width = 2;
+
+    static auto load(const Point2d *p, V &x, V &y) -> void
+    {
+        const auto a = _mm_loadu_pd(&p[0].x);
+        const auto b = _mm_loadu_pd(&p[1].x);
+        x = _mm_unpacklo_pd(a, b);
+        y = _mm_unpackhi_pd(a, b);
+    }
+
+    static auto store(double *out, V v) -> void { _mm_storeu_pd(out, v); }
+
+    static auto set(double v) -> V { return _mm_set1_pd(v); }
+    static auto add(V a, V b) -> V { return _mm_add_pd(a, b); }
+    static auto sub(V a, V b) -> V { return _mm_sub_pd(a, b); }
+    static auto mul(V a, V b) -> V { return _mm_mul_pd(a, b); }
+    static auto floor(V a) -> V { return _mm_floor_pd(a); }
+    static auto abs(V a) -> V { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    static auto toInt(V a) -> I { return _mm_cvttpd_epi32(a); }
+
+    static auto seti(int v) -> I { return _mm_set1_epi32(v); }
+    static auto addi(I a, I b) -> I { return _mm_add_epi32(a, b); }
+    static auto andi(I a, I b) -> I { return _mm_and_si128(a, b); }
+
+    static auto gather(const std::uint8_t *table, I idx) -> I
+    {
+        return _mm_setr_epi32(table[_mm_cvtsi128_si32(idx)], table[_mm_extract_epi32(idx, 1)], 0,
+                              0);
+    }
+
+    static auto widen(I a) -> W { return _mm_cvtepi32_epi64(a); }
+    static auto setw(int v) -> W { return _mm_set1_epi64x(v); }
+    static auto andw(W a, W b) -> W { return _mm_and_si128(a, b); }
+    static auto cmpeqw(W a, W b) -> W { return _mm_cmpeq_epi64(a, b); }
+
+    template <int Bit> static auto bitToSign(W a) -> W
+    {
+        return _mm_slli_epi64(_mm_srli_epi64(a, Bit), 63);
+    }
+
+    static auto select(W mask, V a, V b) -> V
+    {
+        return _mm_blendv_pd(b, a, _mm_castsi128_pd(mask));
+    }
+
+    static auto flipSign(W sign, V a) -> V { return _mm_xor_pd(a, _mm_castsi128_pd(sign)); }
+};
+
+struct Ops4f {
+    using Scalar = float;
+    using V = __m128;
+    using I = __m128i;
+    using W = __m128i;
+
+    static constexpr std::size_t width = 4;
+
+    static auto load(const Point2f *p, V &x, V &y) -> void
+    {
+        const auto a = _mm_loadu_ps(&p[0].x);
+        const auto b = _mm_loadu_ps(&p[2].x);
+        x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+
+    static auto store(float *out, V v) -> void { _mm_storeu_ps(out, v); }
+
+    static auto set(float v) -> V { return _mm_set1_ps(v); }
+    static auto add(V a, V b) -> V { return _mm_add_ps(a, b); }
+    static auto sub(V a, V b) -> V { return _mm_sub_ps(a, b); }
+    static auto mul(V a, V b) -> V { return _mm_mul_ps(a, b); }
+    static auto floor(V a) -> V { return _mm_floor_ps(a); }
+    static auto abs(V a) -> V { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static auto toInt(V a) -> I { return _mm_cvttps_epi32(a); }
+
+    static auto seti(int v) -> I { return _mm_set1_epi32(v); }
+    static auto addi(I a, I b) -> I { return _mm_add_epi32(a, b); }
+    static auto andi(I a, I b) -> I { return _mm_and_si128(a, b); }
+
+    static auto gather(const std::uint8_t *table, I idx) -> I
+    {
+        return _mm_setr_epi32(table[_mm_cvtsi128_si32(idx)], table[_mm_extract_epi32(idx, 1)],
+                              table[_mm_extract_epi32(idx, 2)], table[_mm_extract_epi32(idx, 3)]);
+    }
+
+    static auto widen(I a) -> W { return a; }
+    static auto setw(int v) -> W { return _mm_set1_epi32(v); }
+    static auto andw(W a, W b) -> W { return _mm_and_si128(a, b); }
+    static auto cmpeqw(W a, W b) -> W { return _mm_cmpeq_epi32(a, b); }
+
+    template <int Bit> static auto bitToSign(W a) -> W
+    {
+        return _mm_slli_epi32(_mm_srli_epi32(a, Bit), 31);
+    }
+
+    static auto select(W mask, V a, V b) -> V
+    {
+        return _mm_blendv_ps(b, a, _mm_castsi128_ps(mask));
+    }
+
+    static auto flipSign(W sign, V a) -> V { return _mm_xor_ps(a, _mm_castsi128_ps(sign)); }
+};
+
+#include "PerlinKernel.inl"
+
+} // namespace sse41
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2
+{
+
+// Byte table: load the 32-bit word at each index and keep its low byte
+static auto gatherBytes(const std::uint8_t *table, __m128i idx) -> __m128i
+{
+    const auto words = _mm_i32gather_epi32(reinterpret_cast<const int *>(table), idx, 1);
+    return _mm_and_si128(words, _mm_set1_epi32(255));
+}
+
+static auto gatherBytes(const std::uint8_t *table, __m256i idx) -> __m256i
+{
+    const auto words = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), idx, 1);
+    return _mm256_and_si256(words, _mm256_set1_epi32(255));
+}
+
+struct Ops4d {
+    using Scalar = double;
+    using V = __m256d;
+    using I = __m128i;
+    using W = __m256i;
+
+    static constexpr std::size_t width = 4;
+
+    static auto load(const Point2d *p, V &x, V &y) -> void
+    {
+        // Deinterleave {x0 y0 x1 y1} {x2 y2 x3 y3}
+        const auto a = _mm256_loadu_pd(&p[0].x);
+        const auto b = _mm256_loadu_pd(&p[2].x);
+        x = _mm256_permute4x64_pd(_mm256_unpacklo_pd(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        y = _mm256_permute4x64_pd(_mm256_unpackhi_pd(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+    }
+
+    static auto store(double *out, V v) -> void { _mm256_storeu_pd(out, v); }
+
+    static auto set(double v) -> V { return _mm256_set1_pd(v); }
+    static auto add(V a, V b) -> V { return _mm256_add_pd(a, b); }
+    static auto sub(V a, V b) -> V { return _mm256_sub_pd(a, b); }
+    static auto mul(V a, V b) -> V { return _mm256_mul_pd(a, b); }
+    static auto floor(V a) -> V { return _mm256_floor_pd(a); }
+    static auto abs(V a) -> V { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static auto toInt(V a) -> I { return _mm256_cvttpd_epi32(a); }
+
+    static auto seti(int v) -> I { return _mm_set1_epi32(v); }
+    static auto addi(I a, I b) -> I { return _mm_add_epi32(a, b); }
+    static auto andi(I a, I b) -> I { return _mm_and_si128(a, b); }
+    static auto gather(const std::uint8_t *table, I idx) -> I { return gatherBytes(table, idx); }
+
+    static auto widen(I a) -> W { return _mm256_cvtepi32_epi64(a); }
+    static auto setw(int v) -> W { return _mm256_set1_epi64x(v); }
+    static auto andw(W a, W b) -> W { return _mm256_and_si256(a, b); }
+    static auto cmpeqw(W a, W b) -> W { return _mm256_cmpeq_epi64(a, b); }
+
+    template <int Bit> static auto bitToSign(W a) -> W
+    {
+        return _mm256_slli_epi64(_mm256_srli_epi64(a, Bit), 63);
+    }
+
+    static auto select(W mask, V a, V b) -> V
+    {
+        return _mm256_blendv_pd(b, a, _mm256_castsi256_pd(mask));
+    }
+
+    static auto flipSign(W sign, V a) -> V { return _mm256_xor_pd(a, _mm256_castsi256_pd(sign)); }
+};
+
+struct Ops8f {
+    using Scalar = float;
+    using V = __m256;
+    using I = __m256i;
+    using W = __m256i;
+
+    static constexpr std::size_t width = 8;
+
+    static auto load(const Point2f *p, V &x, V &y) -> void
+    {
+        // Pick x and y from each 128-bit lane, then restore the order of the 64-bit pairs
+        const auto a = _mm256_loadu_ps(&p[0].x);
+        const auto b = _mm256_loadu_ps(&p[4].x);
+        const auto xs = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        const auto ys = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        x = _mm256_castpd_ps(
+            _mm256_permute4x64_pd(_mm256_castps_pd(xs), _MM_SHUFFLE(3, 1, 2, 0)));
+        y = _mm256_castpd_ps(
+            _mm256_permute4x64_pd(_mm256_castps_pd(ys), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    static auto store(float *out, V v) -> void { _mm256_storeu_ps(out, v); }
+
+    static auto set(float v) -> V { return _mm256_set1_ps(v); }
+    static auto add(V a, V b) -> V { return _mm256_add_ps(a, b); }
+    static auto sub(V a, V b) -> V { return _mm256_sub_ps(a, b); }
+    static auto mul(V a, V b) -> V { return _mm256_mul_ps(a, b); }
+    static auto floor(V a) -> V { return _mm256_floor_ps(a); }
+    static auto abs(V a) -> V { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static auto toInt(V a) -> I { return _mm256_cvttps_epi32(a); }
+
+    static auto seti(int v) -> I { return _mm256_set1_epi32(v); }
+    static auto addi(I a, I b) -> I { return _mm256_add_epi32(a, b); }
+    static auto andi(I a, I b) -> I { return _mm256_and_si256(a, b); }
+    static auto gather(const std::uint8_t *table, I idx) -> I { return gatherBytes(table, idx); }
+
+    static auto widen(I a) -> W { return a; }
+    static auto setw(int v) -> W { return _mm256_set1_epi32(v); }
+    static auto andw(W a, W b) -> W { return _mm256_and_si256(a, b); }
+    static auto cmpeqw(W a, W b) -> W { return _mm256_cmpeq_epi32(a, b); }
+
+    template <int Bit> static auto bitToSign(W a) -> W
+    {
+        return _mm256_slli_epi32(_mm256_srli_epi32(a, Bit), 31);
+    }
+
+    static auto select(W mask, V a, V b) -> V
+    {
+        return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask));
+    }
+
+    static auto flipSign(W sign, V a) -> V { return _mm256_xor_ps(a, _mm256_castsi256_ps(sign)); }
+};
+
+#include "PerlinKernel.inl"
 
-    std::shuffle(pee.begin(), pee.begin() + 256, rng);
-    std::copy_n(pee.data(), 256, pee.data() + 256);
+} // namespace avx2
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // MIST_X86_SIMD
+
+static auto supportedSimdLevel() -> SimdLevel
+{
+#ifdef MIST_X86_SIMD
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+        if (__builtin_cpu_supports("sse4.1")) return SimdLevel::Sse41;
+        return SimdLevel::None;
+    }();
+    return level;
+#else
+    return SimdLevel::None;
+#endif
+}
+
+static auto activeSimdLevel() -> std::atomic<SimdLevel> &
+{
+    static std::atomic<SimdLevel> level {supportedSimdLevel()};
+    return level;
+}
+
+auto getNoiseSimdLevel() -> SimdLevel
+{
+    return activeSimdLevel().load(std::memory_order_relaxed);
+}
+
+auto setNoiseSimdLevel(SimdLevel level) -> SimdLevel
+{
+    level = std::min(level, supportedSimdLevel());
+    activeSimdLevel().store(level, std::memory_order_relaxed);
+    return level;
+}
+
+auto perlinSampleManySimd(const PerlinPermutation &perm, std::span<const Point2d> points,
+                          double zOffset, std::span<double> out) -> std::size_t
+{
+    switch (getNoiseSimdLevel()) {
+#ifdef MIST_X86_SIMD
+    case SimdLevel::Avx2:
+        return avx2::perlinKernel<avx2::Ops4d>(perm.data(), points.data(), zOffset, out.data(),
+                                               points.size());
+    case SimdLevel::Sse41:
+        return sse41::perlinKernel<sse41::Ops2d>(perm.data(), points.data(), zOffset, out.data(),
+                                                 points.size());
+#endif
+    default: return 0;
+    }
+}
+
+auto perlinSampleManySimd(const PerlinPermutation &perm, std::span<const Point2f> points,
+                          float zOffset, std::span<float> out) -> std::size_t
+{
+    switch (getNoiseSimdLevel()) {
+#ifdef MIST_X86_SIMD
+    case SimdLevel::Avx2:
+        return avx2::perlinKernel<avx2::Ops8f>(perm.data(), points.data(), zOffset, out.data(),
+                                               points.size());
+    case SimdLevel::Sse41:
+        return sse41::perlinKernel<sse41::Ops4f>(perm.data(), points.data(), zOffset, out.data(),
+                                                 points.size());
+#endif
+    default: return 0;
+    }
+}
+
+auto perlinSampleOctavesSimd(const PerlinPermutation &perm, std::span<const Point2d> points,
+                             double zOffset, const OctaveStack<double> &octaves,
+                             std::span<double> out) -> std::size_t
+{
+    switch (getNoiseSimdLevel()) {
+#ifdef MIST_X86_SIMD
+    case SimdLevel::Avx2:
+        return avx2::perlinOctaveKernel<avx2::Ops4d>(perm.data(), points.data(), zOffset, octaves,
+                                                     out.data(), points.size());
+    case SimdLevel::Sse41:
+        return sse41::perlinOctaveKernel<sse41::Ops2d>(perm.data(), points.data(), zOffset,
+                                                       octaves, out.data(), points.size());
+#endif
+    default: return 0;
+    }
 }
 
-auto perlinHash(int value) -> int
+auto perlinSampleOctavesSimd(const PerlinPermutation &perm, std::span<const Point2f> points,
+                             float zOffset, const OctaveStack<float> &octaves,
+                             std::span<float> out) -> std::size_t
 {
-    return pee[value];
+    switch (getNoiseSimdLevel()) {
+#ifdef MIST_X86_SIMD
+    case SimdLevel::Avx2:
+        return avx2::perlinOctaveKernel<avx2::Ops8f>(perm.data(), points.data(), zOffset, octaves,
+                                                     out.data(), points.size());
+    case SimdLevel::Sse41:
+        return sse41::perlinOctaveKernel<sse41::Ops4f>(perm.data(), points.data(), zOffset,
+                                                       octaves, out.data(), points.size());
+#endif
+    default: return 0;
+    }
 }
 
 } // namespace mist
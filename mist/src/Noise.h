@@ -2,39 +2,230 @@
 #define NOISE2_H_
 
 #include "Matrix.h"
+#include "Parallel.h"
 #include "Point.h"
 
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <functional>
 #include <random>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 namespace mist
 {
 
-auto setPerlinSeed(long seed) -> void;
-auto perlinHash(int value) -> int;
+// Permutation table for Perlin-style noise. Immutable once built, so one table can be shared by any
+// number of generators and threads.
+class PerlinPermutation
+{
+public:
+    // Default permutation
+    PerlinPermutation();
+    // Random permutation, the same for the same seed
+    explicit PerlinPermutation(long seed);
 
-class Noise2
+    [[nodiscard]] auto operator[](int i) const noexcept -> int
+    {
+        return table[static_cast<std::size_t>(i)];
+    }
+
+    [[nodiscard]] auto data() const noexcept -> const std::uint8_t * { return table.data(); }
+
+private:
+    // 256 permuted values repeated twice, so hashing doesn't need to wrap around. The padding lets
+    // SIMD kernels load a full 32-bit word starting at any index.
+    static constexpr std::size_t size = 512;
+    static constexpr std::size_t padding = 64;
+
+    alignas(64) std::array<std::uint8_t, size + padding> table {};
+};
+
+// Instruction sets for batch noise sampling, in increasing order of preference
+enum class SimdLevel { None, Sse41, Avx2 };
+
+// Defaults to the best level supported by the CPU
+auto getNoiseSimdLevel() -> SimdLevel;
+// Caps the level used for batch sampling (e.g. for benchmarks), returns the level now in effect
+auto setNoiseSimdLevel(SimdLevel level) -> SimdLevel;
+
+// Vectorized PerlinNoise2 kernels. Sample a prefix of 'points' and return its length, leaving the
+// tail (and everything, without SIMD support) to the scalar path. Results are bit-identical to the
+// scalar path, unless the compiler contracts the scalar math into FMA instructions (e.g. with
+// -march=native), in which case they differ by less than 1e-12 for double and 1e-5 for float.
+auto perlinSampleManySimd(const PerlinPermutation &perm, std::span<const Point2d> points,
+                          double zOffset, std::span<double> out) -> std::size_t;
+auto perlinSampleManySimd(const PerlinPermutation &perm, std::span<const Point2f> points,
+                          float zOffset, std::span<float> out) -> std::size_t;
+
+// How octave noises combine their octaves: plain fractal Brownian motion, or fBm of shaped noise
+// with sharp creases at the zero crossings (pointing up for Ridged, down for Billow).
+enum class OctaveMode { Fbm, Ridged, Billow };
+
+// Octave parameters, with the per-octave frequencies and amplitudes computed once when they change
+template <typename T> class OctaveStack
 {
 public:
-    virtual ~Noise2() = default;
-    virtual auto sample(const Point2d &) -> double = 0;
+    OctaveStack() { update(); }
+
+    auto setNumOctaves(int numOctaves_) -> void
+    {
+        numOctaves = std::max(0, numOctaves_);
+        update();
+    }
+
+    auto setRoughness(T roughness_) -> void
+    {
+        roughness = roughness_;
+        update();
+    }
+
+    auto setFrequencyMultiplier(T frequencyMultiplier_) -> void
+    {
+        frequencyMultiplier = frequencyMultiplier_;
+        update();
+    }
+
+    auto setMode(OctaveMode mode_) -> void { mode = mode_; }
+
+    [[nodiscard]] auto getNumOctaves() const noexcept -> int { return numOctaves; }
+    [[nodiscard]] auto getMode() const noexcept -> OctaveMode { return mode; }
+    [[nodiscard]] auto frequencies() const noexcept -> std::span<const T> { return frequency; }
+    [[nodiscard]] auto amplitudes() const noexcept -> std::span<const T> { return amplitude; }
+
+    // Maps a single octave's noise value according to the mode
+    [[nodiscard]] auto shape(T n) const -> T
+    {
+        switch (mode) {
+        case OctaveMode::Ridged: {
+            const T r = 1 - std::abs(n);
+            return r * r * 2 - 1;
+        }
+        case OctaveMode::Billow: return std::abs(n) * 2 - 1;
+        default: return n;
+        }
+    }
+
+private:
+    int            numOctaves {5};
+    T              roughness {static_cast<T>(0.75)};
+    T              frequencyMultiplier {2};
+    OctaveMode     mode {OctaveMode::Fbm};
+    std::vector<T> frequency;
+    std::vector<T> amplitude;
+
+    auto update() -> void
+    {
+        const T G = std::pow(static_cast<T>(2), -roughness);
+        const auto n = static_cast<std::size_t>(numOctaves);
+        frequency.resize(n);
+        amplitude.resize(n);
+
+        T freq = 1;
+        T amp = 1;
+        for (std::size_t i = 0; i < n; ++i) {
+            frequency[i] = freq;
+            amplitude[i] = amp;
+            freq *= frequencyMultiplier;
+            amp *= G;
+        }
+    }
 };
 
-class PerlinNoise2 : public Noise2
+// Fused octaves of PerlinNoise2: every octave of a batch of points in one pass, with the same
+// results and guarantees as perlinSampleManySimd().
+auto perlinSampleOctavesSimd(const PerlinPermutation &perm, std::span<const Point2d> points,
+                             double zOffset, const OctaveStack<double> &octaves,
+                             std::span<double> out) -> std::size_t;
+auto perlinSampleOctavesSimd(const PerlinPermutation &perm, std::span<const Point2f> points,
+                             float zOffset, const OctaveStack<float> &octaves,
+                             std::span<float> out) -> std::size_t;
+
+// Noise over a 2D plane, computed with the scalar type T (float or double)
+template <typename T> class BasicNoise2
 {
 public:
-    static auto setSeed(long seed) -> void { setPerlinSeed(seed); }
+    using Scalar = T;
 
-    PerlinNoise2(double zOffset_ = 0) : zOffset(zOffset_) {}
+    virtual ~BasicNoise2() = default;
+    virtual auto sample(const Point2<T> &) -> T = 0;
 
-    double sample(const Point2d &p) override
+    // Samples every point into the corresponding element of 'out', which must be at least as large
+    // as 'points'. Results are identical to calling sample() for each point.
+    virtual auto sampleMany(std::span<const Point2<T>> points, std::span<T> out) -> void
     {
-        double x = p.x;
-        double y = p.y;
-        double z = zOffset;
+        for (std::size_t i = 0; i < points.size(); ++i)
+            out[i] = sample(points[i]);
+    }
+
+protected:
+    // Number of points composite noises process at once, using stack buffers
+    static constexpr std::size_t batchSize = 256;
+};
+
+using Noise2 = BasicNoise2<double>;
+using Noise2f = BasicNoise2<float>;
+
+/* -------------------------------------------------------------------------- */
+
+template <typename T> class BasicPerlinNoise2 final : public BasicNoise2<T>
+{
+public:
+    BasicPerlinNoise2(T zOffset_ = 0) : zOffset(zOffset_) {}
+    BasicPerlinNoise2(const PerlinPermutation &perm_, T zOffset_ = 0)
+        : perm(perm_), zOffset(zOffset_)
+    {
+    }
+
+    auto setSeed(long seed) -> BasicPerlinNoise2 &
+    {
+        perm = PerlinPermutation(seed);
+        return *this;
+    }
+
+    T sample(const Point2<T> &p) override { return evaluate(p.x, p.y); }
+
+    auto sampleMany(std::span<const Point2<T>> points, std::span<T> out) -> void override
+    {
+        std::size_t i = 0;
+        if constexpr (std::is_same_v<T, double> || std::is_same_v<T, float>)
+            i = perlinSampleManySimd(perm, points, zOffset, out);
+
+        for (; i < points.size(); ++i)
+            out[i] = evaluate(points[i].x, points[i].y);
+    }
+
+    // Sums all octaves of this noise at each point, without going through sample()
+    auto sampleOctaves(std::span<const Point2<T>> points, const OctaveStack<T> &octaves,
+                       std::span<T> out) const -> void
+    {
+        std::size_t i = 0;
+        if constexpr (std::is_same_v<T, double> || std::is_same_v<T, float>)
+            i = perlinSampleOctavesSimd(perm, points, zOffset, octaves, out);
+
+        const auto frequencies = octaves.frequencies();
+        const auto amplitudes = octaves.amplitudes();
+        for (; i < points.size(); ++i) {
+            T total = 0;
+            for (std::size_t j = 0; j < frequencies.size(); ++j) {
+                const T n = evaluate(points[i].x * frequencies[j], points[i].y * frequencies[j]);
+                total += amplitudes[j] * octaves.shape(n);
+            }
+            out[i] = total;
+        }
+    }
+
+private:
+    PerlinPermutation perm;
+    T                 zOffset;
+
+    auto evaluate(T x, T y) const -> T
+    {
+        T z = zOffset;
 
         // Find unit curve that contains the point
         const int X = static_cast<int>(std::floor(x)) & 255;
@@ -44,167 +235,487 @@ public:
         x -= std::floor(x);
         y -= std::floor(y);
         z -= std::floor(z);
-        // Compute fade curves for each of x,y,z
-        const double u = fade(x);
-        const double v = fade(y);
-        const double w = fade(z);
+        // Compute fade curves for x and y
+        const T u = fade(x);
+        const T v = fade(y);
 
         // Hash coordinates of cube corners
-        const int A = perlinHash(X) + Y;
-        const int AA = perlinHash(A) + Z;
-        const int AB = perlinHash(A + 1) + Z;
-        const int B = perlinHash(X + 1) + Y;
-        const int BA = perlinHash(B) + Z;
-        const int BB = perlinHash(B + 1) + Z;
-
-        // Add blended results from 8 corners of the cube
+        const int A = perm[X] + Y;
+        const int AA = perm[A] + Z;
+        const int AB = perm[A + 1] + Z;
+        const int B = perm[X + 1] + Y;
+        const int BA = perm[B] + Z;
+        const int BB = perm[B + 1] + Z;
+
+        // Blend the 4 corners of the face below the point. For integer z that is the result, as
+        // fade(0) = 0 and the face above doesn't contribute.
         // clang-format off
-        return lerp(
-            w,
+        const T below =
             lerp(v,
-                lerp(u, grad(perlinHash(AA), x, y, z), grad(perlinHash(BA), x - 1, y, z)),
-                lerp(u, grad(perlinHash(AB), x, y - 1, z), grad(perlinHash(BB), x - 1, y - 1, z))
-                ), 
+                lerp(u, grad(perm[AA], x, y, z), grad(perm[BA], x - 1, y, z)),
+                lerp(u, grad(perm[AB], x, y - 1, z), grad(perm[BB], x - 1, y - 1, z)));
+        if (z == 0) return below;
+
+        const T above =
             lerp(v,
-                lerp(u, grad(perlinHash(AA + 1), x, y, z - 1), grad(perlinHash(BA + 1), x - 1, y, z - 1)),
-                lerp(u, grad(perlinHash(AB + 1), x, y - 1, z - 1), grad(perlinHash(BB + 1), x - 1, y - 1, z - 1))
-                )
-        );
+                lerp(u, grad(perm[AA + 1], x, y, z - 1), grad(perm[BA + 1], x - 1, y, z - 1)),
+                lerp(u, grad(perm[AB + 1], x, y - 1, z - 1),
+                        grad(perm[BB + 1], x - 1, y - 1, z - 1)));
         // clang-format on
-    }
 
-private:
-    double zOffset;
+        return lerp(fade(z), below, above);
+    }
 
-    static double fade(double t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+    static T fade(T t) { return t * t * t * (t * (t * 6 - 15) + 10); }
 
-    static double lerp(double t, double a, double b) { return a + t * (b - a); }
+    static T lerp(T t, T a, T b) { return a + t * (b - a); }
 
-    static double grad(int perlinHash, double x, double y, double z)
+    static T grad(int hash, T x, T y, T z)
     {
-        const int  h = perlinHash & 15;
+        const int  h = hash & 15;
         const auto u = h < 8 ? x : y;
         const auto v = h < 4 ? y : h == 12 || h == 14 ? x : z;
         return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
     }
 };
 
+using PerlinNoise2 = BasicPerlinNoise2<double>;
+using PerlinNoise2f = BasicPerlinNoise2<float>;
+
 /* -------------------------------------------------------------------------- */
 
-class OctaveNoise2 : public Noise2
+// 2D simplex noise. Each sample blends the 3 corners of a triangle instead of the 4 (or 8, for
+// non-integer z) corners Perlin noise needs, with fewer axis-aligned artifacts. Seeded like
+// BasicPerlinNoise2. Values lie in [-1, 1].
+template <typename T> class BasicSimplexNoise2 final : public BasicNoise2<T>
 {
+public:
+    BasicSimplexNoise2() = default;
+    BasicSimplexNoise2(const PerlinPermutation &perm_) : perm(perm_) {}
+
+    auto setSeed(long seed) -> BasicSimplexNoise2 &
+    {
+        perm = PerlinPermutation(seed);
+        return *this;
+    }
+
+    T sample(const Point2<T> &p) override { return evaluate(p.x, p.y); }
+
+    auto sampleMany(std::span<const Point2<T>> points, std::span<T> out) -> void override
+    {
+        for (std::size_t i = 0; i < points.size(); ++i)
+            out[i] = evaluate(points[i].x, points[i].y);
+    }
+
+private:
+    PerlinPermutation perm;
+
+    // Factors mapping the triangle grid to a square grid and back: (sqrt(3) - 1) / 2 and
+    // (3 - sqrt(3)) / 6
+    static constexpr T skew = static_cast<T>(0.366025403784438646764);
+    static constexpr T unskew = static_cast<T>(0.211324865405187117745);
+
+    auto evaluate(T x, T y) const -> T
+    {
+        // Find the skewed unit square that contains the point, and the position of the point
+        // relative to its first corner
+        const T s = (x + y) * skew;
+        const T i = std::floor(x + s);
+        const T j = std::floor(y + s);
+        const T t = (i + j) * unskew;
+        const T x0 = x - (i - t);
+        const T y0 = y - (j - t);
+
+        // The square is made of two triangles, pick the middle corner of the one we're in
+        const int i1 = x0 > y0 ? 1 : 0;
+        const int j1 = 1 - i1;
+
+        const T x1 = x0 - static_cast<T>(i1) + unskew;
+        const T y1 = y0 - static_cast<T>(j1) + unskew;
+        const T x2 = x0 - 1 + 2 * unskew;
+        const T y2 = y0 - 1 + 2 * unskew;
+
+        // Hash coordinates of the triangle corners
+        const int I = static_cast<int>(i) & 255;
+        const int J = static_cast<int>(j) & 255;
+
+        const T n0 = corner(perm[I + perm[J]], x0, y0);
+        const T n1 = corner(perm[I + i1 + perm[J + j1]], x1, y1);
+        const T n2 = corner(perm[I + 1 + perm[J + 1]], x2, y2);
+
+        return 40 * (n0 + n1 + n2);
+    }
+
+    // Contribution of a corner at offset (x, y) from the point, fading to 0 at distance sqrt(0.5)
+    static T corner(int hash, T x, T y)
+    {
+        T t = static_cast<T>(0.5) - x * x - y * y;
+        if (t < 0) return 0;
+        t *= t;
+        return t * t * grad(hash, x, y);
+    }
+
+    // Dot product with one of 8 gradients, (+-1, +-2) and (+-2, +-1)
+    static T grad(int hash, T x, T y)
+    {
+        const int  h = hash & 7;
+        const auto u = h < 4 ? x : y;
+        const auto v = h < 4 ? y : x;
+        return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? 2 * v : -2 * v);
+    }
+};
+
+using SimplexNoise2 = BasicSimplexNoise2<double>;
+using SimplexNoise2f = BasicSimplexNoise2<float>;
+
+/* -------------------------------------------------------------------------- */
+
+// Sum of octaves of another noise. Perlin noise gets a fused path evaluating all octaves at once.
+template <typename T> class BasicOctaveNoise2 : public BasicNoise2<T>
+{
+    using BasicNoise2<T>::batchSize;
 
 public:
-    OctaveNoise2(Noise2 &noise_) : noise(noise_) {}
+    BasicOctaveNoise2(BasicNoise2<T> &noise_)
+        : noise(noise_), perlin(dynamic_cast<BasicPerlinNoise2<T> *>(&noise_))
+    {
+    }
 
-    auto setNumOctaves(int numOctaves_) -> OctaveNoise2 &
+    auto setNumOctaves(int numOctaves_) -> BasicOctaveNoise2 &
     {
-        numOctaves = numOctaves_;
+        octaves.setNumOctaves(numOctaves_);
         return *this;
     }
 
-    auto setRoughness(double roughness_) -> OctaveNoise2 &
+    auto setRoughness(T roughness_) -> BasicOctaveNoise2 &
     {
-        roughness = roughness_;
+        octaves.setRoughness(roughness_);
         return *this;
     }
 
-    auto setFrequencyMultiplier(double frequencyMultiplier_) -> OctaveNoise2 &
+    auto setFrequencyMultiplier(T frequencyMultiplier_) -> BasicOctaveNoise2 &
     {
-        frequencyMultiplier = frequencyMultiplier_;
+        octaves.setFrequencyMultiplier(frequencyMultiplier_);
         return *this;
     }
 
-    auto sample(const Point2<double> &p) -> double override
+    auto setMode(OctaveMode mode_) -> BasicOctaveNoise2 &
     {
-        const double G = std::pow(static_cast<double>(2), -roughness);
-        double       total = 0;
-        double       freq = 1.0;
-        double       amplitude = 1.0;
-        for (auto i = 0; i < numOctaves; ++i) {
-            total += amplitude * noise.sample({p.x * freq, p.y * freq});
-            freq *= frequencyMultiplier;
-            amplitude *= G;
+        octaves.setMode(mode_);
+        return *this;
+    }
+
+    auto sample(const Point2<T> &p) -> T override
+    {
+        if (perlin) {
+            T total = 0;
+            perlin->sampleOctaves({&p, 1}, octaves, {&total, 1});
+            return total;
+        }
+
+        const auto frequencies = octaves.frequencies();
+        const auto amplitudes = octaves.amplitudes();
+        T          total = 0;
+        for (std::size_t i = 0; i < frequencies.size(); ++i) {
+            const auto freq = frequencies[i];
+            total += amplitudes[i] * octaves.shape(noise.sample({p.x * freq, p.y * freq}));
         }
         return total;
     }
 
+    auto sampleMany(std::span<const Point2<T>> points, std::span<T> out) -> void override
+    {
+        if (perlin) {
+            perlin->sampleOctaves(points, octaves, out);
+            return;
+        }
+
+        const auto frequencies = octaves.frequencies();
+        const auto amplitudes = octaves.amplitudes();
+
+        std::array<Point2<T>, batchSize> scaled;
+        std::array<T, batchSize>         octave;
+
+        for (std::size_t first = 0; first < points.size(); first += batchSize) {
+            const auto n = std::min(batchSize, points.size() - first);
+            const auto src = points.subspan(first, n);
+            const auto dst = out.subspan(first, n);
+            std::fill(dst.begin(), dst.end(), static_cast<T>(0));
+
+            for (std::size_t i = 0; i < frequencies.size(); ++i) {
+                const auto freq = frequencies[i];
+                for (std::size_t j = 0; j < n; ++j)
+                    scaled[j] = {src[j].x * freq, src[j].y * freq};
+
+                noise.sampleMany({scaled.data(), n}, {octave.data(), n});
+
+                for (std::size_t j = 0; j < n; ++j)
+                    dst[j] += amplitudes[i] * octaves.shape(octave[j]);
+            }
+        }
+    }
+
 private:
-    Noise2 &noise;
-    int     numOctaves {5};
-    double  roughness {0.75};
-    double  frequencyMultiplier {2};
+    BasicNoise2<T>       &noise;
+    BasicPerlinNoise2<T> *perlin;
+    OctaveStack<T>        octaves;
 };
 
+using OctaveNoise2 = BasicOctaveNoise2<double>;
+using OctaveNoise2f = BasicOctaveNoise2<float>;
+
 /* -------------------------------------------------------------------------- */
 
-class DomainWarpedNoise2 : public Noise2
+template <typename T> class BasicDomainWarpedNoise2 : public BasicNoise2<T>
 {
+    using BasicNoise2<T>::batchSize;
+
 public:
-    DomainWarpedNoise2(Noise2 &noise_) : noise(noise_) {}
+    BasicDomainWarpedNoise2(BasicNoise2<T> &noise_) : noise(noise_) {}
 
-    auto sample(const Point2d &p) -> double override
+    auto sample(const Point2<T> &p) -> T override
     {
-        const Point2d q {noise.sample(p), noise.sample(p + offset)};
+        const Point2<T> q {noise.sample(p), noise.sample(p + offset)};
 
         return noise.sample(q);
     }
 
-    auto setOffset(const Point2d &offset_) -> DomainWarpedNoise2 &
+    auto sampleMany(std::span<const Point2<T>> points, std::span<T> out) -> void override
+    {
+        std::array<Point2<T>, batchSize> shifted;
+        std::array<T, batchSize>         qx;
+        std::array<T, batchSize>         qy;
+
+        for (std::size_t first = 0; first < points.size(); first += batchSize) {
+            const auto n = std::min(batchSize, points.size() - first);
+            const auto src = points.subspan(first, n);
+
+            for (std::size_t j = 0; j < n; ++j)
+                shifted[j] = src[j] + offset;
+
+            noise.sampleMany(src, {qx.data(), n});
+            noise.sampleMany({shifted.data(), n}, {qy.data(), n});
+
+            for (std::size_t j = 0; j < n; ++j)
+                shifted[j] = {qx[j], qy[j]};
+
+            noise.sampleMany({shifted.data(), n}, out.subspan(first, n));
+        }
+    }
+
+    auto setOffset(const Point2<T> &offset_) -> BasicDomainWarpedNoise2 &
     {
         offset = offset_;
         return *this;
     }
 
 private:
-    Noise2 &noise;
-    Point2d offset {3.2, 1.3};
+    BasicNoise2<T> &noise;
+    Point2<T>       offset {static_cast<T>(3.2), static_cast<T>(1.3)};
 };
 
+using DomainWarpedNoise2 = BasicDomainWarpedNoise2<double>;
+using DomainWarpedNoise2f = BasicDomainWarpedNoise2<float>;
+
 /* -------------------------------------------------------------------------- */
 
-template <typename T = double> class NoiseTextureBuilder2
+namespace detail
+{
+
+// Fills 'row' with the texels of a texture of 'size' from 'first' on, as the texture builders
+// below do. 'points' and 'values' are scratch space as long as 'row'.
+template <typename T, typename S>
+auto buildTexels(BasicNoise2<S> &noise, const Point2i &size, const Point2i &first, S noiseScale,
+                 S xScale, S yScale, std::span<Point2<S>> points, std::span<S> values,
+                 std::span<T> row) -> void
+{
+    for (std::size_t i = 0; i < row.size(); ++i) {
+        Point2<S> pRel {static_cast<S>(first.x + static_cast<int>(i)) / static_cast<S>(size.x),
+                        static_cast<S>(first.y) / static_cast<S>(size.y)};
+        pRel.x *= xScale;
+        pRel.y *= yScale;
+        points[i] = pRel;
+    }
+
+    noise.sampleMany(points, values);
+
+    for (std::size_t i = 0; i < row.size(); ++i) {
+        row[i] = std::clamp(static_cast<T>(values[i] * noiseScale), static_cast<T>(-1.0),
+                            static_cast<T>(1.0));
+    }
+}
+
+} // namespace detail
+
+// Fills a texture of T with noise computed in the scalar type S
+template <typename T = double, typename S = double> class NoiseTextureBuilder2
 {
 public:
-    NoiseTextureBuilder2(Matrix<T> &texture_, Noise2 &noise_) : texture(texture_), noise(noise_) {}
+    NoiseTextureBuilder2(Matrix<T> &texture_, BasicNoise2<S> &noise_)
+        : texture(texture_), noise(noise_)
+    {
+    }
 
-    NoiseTextureBuilder2 &setNoiseScale(double scale)
+    NoiseTextureBuilder2 &setNoiseScale(S scale)
     {
         noiseScale = scale;
         return *this;
     }
 
-    NoiseTextureBuilder2 &setXScale(double scale)
+    NoiseTextureBuilder2 &setXScale(S scale)
     {
         xScale = scale;
         return *this;
     }
 
-    NoiseTextureBuilder2 &setYScale(double scale)
+    NoiseTextureBuilder2 &setYScale(S scale)
     {
         yScale = scale;
         return *this;
     }
 
+    // Number of threads used by build(), 0 = one per core. The noise must support concurrent
+    // sampling, which all noises in this file do.
+    NoiseTextureBuilder2 &setThreadCount(int threadCount_)
+    {
+        threadCount = threadCount_;
+        return *this;
+    }
+
+    // Fills the texture tile by tile. The result doesn't depend on the number of threads.
     auto build()
     {
-        texture.generate([&](const Point2i &p) {
-            Point2d pRel {static_cast<double>(p.x) / static_cast<double>(texture.getXSize()),
-                          static_cast<double>(p.y) / static_cast<double>(texture.getYSize())};
-            pRel.x *= xScale;
-            pRel.y *= yScale;
-            return std::clamp(static_cast<T>(noise.sample(pRel) * noiseScale), static_cast<T>(-1.0),
-                              static_cast<T>(1.0));
+        const auto xTiles = (texture.getXSize() + tileSize - 1) / tileSize;
+        const auto yTiles = (texture.getYSize() + tileSize - 1) / tileSize;
+
+        parallelFor(xTiles * yTiles, threadCount, [&](int tile, int) {
+            buildTile(Point2i {tile % xTiles, tile / xTiles} * tileSize);
         });
+        texture.markModified();
     }
 
 private:
-    Matrix<T> &texture;
-    Noise2    &noise;
+    Matrix<T>      &texture;
+    BasicNoise2<S> &noise;
+
+    S   noiseScale {1};
+    S   xScale {1};
+    S   yScale {1};
+    int threadCount {1};
+
+    // Tiles of samples fit in L1, and the noise is called once per tile row
+    static constexpr int tileSize = 64;
+
+    auto buildTile(const Point2i &origin) -> void
+    {
+        const auto yEnd = std::min(origin.y + tileSize, texture.getYSize());
+        const auto n = static_cast<std::size_t>(
+            std::min(origin.x + tileSize, texture.getXSize()) - origin.x);
+
+        std::array<Point2<S>, tileSize> points;
+        std::array<S, tileSize>         values;
 
-    double noiseScale {1};
-    double xScale {1};
-    double yScale {1};
+        for (auto y = origin.y; y < yEnd; ++y) {
+            detail::buildTexels(noise, texture.getSize(), {origin.x, y}, noiseScale, xScale,
+                                yScale, std::span(points.data(), n), std::span(values.data(), n),
+                                texture.row(y).subspan(static_cast<std::size_t>(origin.x), n));
+        }
+    }
+};
+
+/* -------------------------------------------------------------------------- */
+
+// Generates a world too large to hold in memory, one tile at a time. Texel (x, y) of the world gets
+// the same value NoiseTextureBuilder2 would give it in a texture of the world's size, so tiles join
+// without seams and peak memory is one tile per thread.
+template <typename T = double, typename S = double> class NoiseStreamBuilder2
+{
+public:
+    using Size = Point2i;
+
+    NoiseStreamBuilder2(const Size &worldSize_, BasicNoise2<S> &noise_)
+        : worldSize(worldSize_), noise(noise_)
+    {
+    }
+
+    NoiseStreamBuilder2 &setNoiseScale(S scale)
+    {
+        noiseScale = scale;
+        return *this;
+    }
+
+    NoiseStreamBuilder2 &setXScale(S scale)
+    {
+        xScale = scale;
+        return *this;
+    }
+
+    NoiseStreamBuilder2 &setYScale(S scale)
+    {
+        yScale = scale;
+        return *this;
+    }
+
+    // Tiles at the right and bottom edges of the world are clipped to it. Throws
+    // std::invalid_argument unless both sizes are positive.
+    NoiseStreamBuilder2 &setTileSize(const Size &tileSize_)
+    {
+        if (tileSize_.x <= 0 || tileSize_.y <= 0)
+            throw std::invalid_argument("Tile size must be positive");
+        tileSize = tileSize_;
+        return *this;
+    }
+
+    // Number of threads used by build(), 0 = one per core
+    NoiseStreamBuilder2 &setThreadCount(int threadCount_)
+    {
+        threadCount = threadCount_;
+        return *this;
+    }
+
+    // Calls sink(origin, tile) with every tile of the world, in no particular order. 'origin' is
+    // the world position of the tile's top left texel. With more than one thread the sink is
+    // called concurrently and must synchronize any shared state itself.
+    template <class Sink> auto build(Sink sink) -> void
+    {
+        const auto xTiles = (worldSize.x + tileSize.x - 1) / tileSize.x;
+        const auto yTiles = (worldSize.y + tileSize.y - 1) / tileSize.y;
+
+        parallelFor(xTiles * yTiles, threadCount, [&](int index, int) {
+            const Point2i origin {index % xTiles * tileSize.x, index / xTiles * tileSize.y};
+
+            Matrix<T> tile(std::min(tileSize.x, worldSize.x - origin.x),
+                           std::min(tileSize.y, worldSize.y - origin.y));
+            buildTile(origin, tile);
+            sink(origin, static_cast<const Matrix<T> &>(tile));
+        });
+    }
+
+    // Fills 'tile' with the part of the world whose top left texel is 'origin'
+    auto buildTile(const Point2i &origin, Matrix<T> &tile) -> void
+    {
+        const auto n = static_cast<std::size_t>(tile.getXSize());
+
+        std::vector<Point2<S>> points(n);
+        std::vector<S>         values(n);
+
+        for (auto y = 0; y < tile.getYSize(); ++y) {
+            detail::buildTexels(noise, worldSize, origin + Point2i {0, y}, noiseScale, xScale,
+                                yScale, std::span(points), std::span(values), tile.row(y));
+        }
+
+        tile.markModified();
+    }
+
+private:
+    Size            worldSize;
+    BasicNoise2<S> &noise;
+
+    S    noiseScale {1};
+    S    xScale {1};
+    S    yScale {1};
+    Size tileSize {256, 256};
+    int  threadCount {1};
 };
 
 } // namespace mist
@@ -0,0 +1,191 @@
+#ifndef NOISEGRAPH_H_
+#define NOISEGRAPH_H_
+
+#include "Noise.h"
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <type_traits>
+
+namespace mist
+{
+
+// Noise graphs composed at compile time, e.g. Warp<Octave<PerlinNoise2>>. Each node owns its source
+// by value and calls it directly, so the whole graph inlines into one sampler. Any type with the
+// sample()/sampleMany() members of BasicNoise2 can be a source; final classes such as
+// BasicPerlinNoise2 are called without virtual dispatch. Wrap a graph in NoiseAdapter to use it
+// where a BasicNoise2 is expected.
+namespace compose
+{
+
+template <class Source> class Octave
+{
+public:
+    using Scalar = typename Source::Scalar;
+
+    Octave() = default;
+    explicit Octave(const Source &source_) : src(source_) {}
+
+    auto setNumOctaves(int numOctaves_) -> Octave &
+    {
+        octaves.setNumOctaves(numOctaves_);
+        return *this;
+    }
+
+    auto setRoughness(Scalar roughness_) -> Octave &
+    {
+        octaves.setRoughness(roughness_);
+        return *this;
+    }
+
+    auto setFrequencyMultiplier(Scalar frequencyMultiplier_) -> Octave &
+    {
+        octaves.setFrequencyMultiplier(frequencyMultiplier_);
+        return *this;
+    }
+
+    auto setMode(OctaveMode mode_) -> Octave &
+    {
+        octaves.setMode(mode_);
+        return *this;
+    }
+
+    [[nodiscard]] auto source() noexcept -> Source & { return src; }
+
+    // A single point skips the SIMD dispatch of sampleOctaves(), so Perlin sources inline fully
+    auto sample(const Point2<Scalar> &p) -> Scalar
+    {
+        const auto frequencies = octaves.frequencies();
+        const auto amplitudes = octaves.amplitudes();
+        Scalar     total = 0;
+        for (std::size_t i = 0; i < frequencies.size(); ++i) {
+            const auto freq = frequencies[i];
+            total += amplitudes[i] * octaves.shape(src.sample({p.x * freq, p.y * freq}));
+        }
+        return total;
+    }
+
+    auto sampleMany(std::span<const Point2<Scalar>> points, std::span<Scalar> out) -> void
+    {
+        if constexpr (isPerlin) {
+            src.sampleOctaves(points, octaves, out);
+        } else {
+            const auto frequencies = octaves.frequencies();
+            const auto amplitudes = octaves.amplitudes();
+
+            std::array<Point2<Scalar>, batchSize> scaled;
+            std::array<Scalar, batchSize>         octave;
+
+            for (std::size_t first = 0; first < points.size(); first += batchSize) {
+                const auto n = std::min(batchSize, points.size() - first);
+                const auto srcPoints = points.subspan(first, n);
+                const auto dst = out.subspan(first, n);
+                std::fill(dst.begin(), dst.end(), static_cast<Scalar>(0));
+
+                for (std::size_t i = 0; i < frequencies.size(); ++i) {
+                    const auto freq = frequencies[i];
+                    for (std::size_t j = 0; j < n; ++j)
+                        scaled[j] = {srcPoints[j].x * freq, srcPoints[j].y * freq};
+
+                    src.sampleMany({scaled.data(), n}, {octave.data(), n});
+
+                    for (std::size_t j = 0; j < n; ++j)
+                        dst[j] += amplitudes[i] * octaves.shape(octave[j]);
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr bool        isPerlin = std::is_same_v<Source, BasicPerlinNoise2<Scalar>>;
+    static constexpr std::size_t batchSize = 256;
+
+    Source              src;
+    OctaveStack<Scalar> octaves;
+};
+
+/* -------------------------------------------------------------------------- */
+
+template <class Source> class Warp
+{
+public:
+    using Scalar = typename Source::Scalar;
+
+    Warp() = default;
+    explicit Warp(const Source &source_) : src(source_) {}
+
+    auto setOffset(const Point2<Scalar> &offset_) -> Warp &
+    {
+        offset = offset_;
+        return *this;
+    }
+
+    [[nodiscard]] auto source() noexcept -> Source & { return src; }
+
+    auto sample(const Point2<Scalar> &p) -> Scalar
+    {
+        const Point2<Scalar> q {src.sample(p), src.sample(p + offset)};
+
+        return src.sample(q);
+    }
+
+    auto sampleMany(std::span<const Point2<Scalar>> points, std::span<Scalar> out) -> void
+    {
+        std::array<Point2<Scalar>, batchSize> shifted;
+        std::array<Scalar, batchSize>         qx;
+        std::array<Scalar, batchSize>         qy;
+
+        for (std::size_t first = 0; first < points.size(); first += batchSize) {
+            const auto n = std::min(batchSize, points.size() - first);
+            const auto srcPoints = points.subspan(first, n);
+
+            for (std::size_t j = 0; j < n; ++j)
+                shifted[j] = srcPoints[j] + offset;
+
+            src.sampleMany(srcPoints, {qx.data(), n});
+            src.sampleMany({shifted.data(), n}, {qy.data(), n});
+
+            for (std::size_t j = 0; j < n; ++j)
+                shifted[j] = {qx[j], qy[j]};
+
+            src.sampleMany({shifted.data(), n}, out.subspan(first, n));
+        }
+    }
+
+private:
+    static constexpr std::size_t batchSize = 256;
+
+    Source         src;
+    Point2<Scalar> offset {static_cast<Scalar>(3.2), static_cast<Scalar>(1.3)};
+};
+
+} // namespace compose
+
+/* -------------------------------------------------------------------------- */
+
+// Runtime BasicNoise2 interface over a compile-time noise graph
+template <class Graph> class NoiseAdapter final : public BasicNoise2<typename Graph::Scalar>
+{
+public:
+    using Scalar = typename Graph::Scalar;
+
+    NoiseAdapter() = default;
+    explicit NoiseAdapter(const Graph &graph_) : g(graph_) {}
+
+    [[nodiscard]] auto graph() noexcept -> Graph & { return g; }
+
+    auto sample(const Point2<Scalar> &p) -> Scalar override { return g.sample(p); }
+
+    auto sampleMany(std::span<const Point2<Scalar>> points, std::span<Scalar> out) -> void override
+    {
+        g.sampleMany(points, out);
+    }
+
+private:
+    Graph g;
+};
+
+} // namespace mist
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mist
+{
+
+[[nodiscard]] inline auto hardwareThreadCount() -> int
+{
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+namespace detail
+{
+
+// Tasks of one parallelFor() or WorkerPool::run(), grabbed by the threads one at a time
+class TaskQueue
+{
+public:
+    explicit TaskQueue(int numTasks_ = 0) : numTasks(numTasks_) {}
+
+    auto reset(int numTasks_) -> void
+    {
+        numTasks = numTasks_;
+        nextTask = 0;
+        failed = false;
+        error = nullptr;
+    }
+
+    template <class F> auto work(F &func, int worker) -> void
+    {
+        while (!failed.load(std::memory_order_relaxed)) {
+            const auto task = nextTask.fetch_add(1, std::memory_order_relaxed);
+            if (task >= numTasks) return;
+
+            try {
+                func(task, worker);
+            } catch (...) {
+                const std::lock_guard lock(errorMutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            }
+        }
+    }
+
+    // Once every thread has stopped
+    auto rethrow() const -> void
+    {
+        if (error) std::rethrow_exception(error);
+    }
+
+private:
+    int                numTasks;
+    std::atomic<int>   nextTask {0};
+    std::atomic<bool>  failed {false};
+    std::exception_ptr error;
+    std::mutex         errorMutex;
+};
+
+} // namespace detail
+
+// Runs func(task, worker) for every task in [0, numTasks), on up to numThreads threads (0 = one per
+// core). Idle threads grab the next task as soon as they finish one, so uneven tasks balance out.
+// 'worker' is in [0, numThreads) and is unique among concurrently running calls, so it can index
+// per-thread scratch buffers. The calling thread is worker 0. If tasks throw, remaining tasks are
+// skipped and the first exception is rethrown once all threads have stopped.
+template <class F> auto parallelFor(int numTasks, int numThreads, F func) -> void
+{
+    if (numThreads <= 0) numThreads = hardwareThreadCount();
+    numThreads = std::min(numThreads, numTasks);
+
+    if (numThreads <= 1) {
+        for (int task = 0; task < numTasks; ++task)
+            func(task, 0);
+        return;
+    }
+
+    detail::TaskQueue tasks(numTasks);
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(static_cast<std::size_t>(numThreads - 1));
+        for (int worker = 1; worker < numThreads; ++worker)
+            threads.emplace_back([&](int w) { tasks.work(func, w); }, worker);
+
+        tasks.work(func, 0);
+    }
+    tasks.rethrow();
+}
+
+// Threads that wait between calls of run(), which runs tasks like parallelFor() without starting
+// threads or allocating, for work handed out too often to start threads every time. One call of
+// run() at a time.
+class WorkerPool
+{
+public:
+    // numThreads counts the thread calling run() (0 = one per core)
+    explicit WorkerPool(int numThreads = 0)
+    {
+        if (numThreads <= 0) numThreads = hardwareThreadCount();
+
+        threads.reserve(static_cast<std::size_t>(numThreads - 1));
+        for (int worker = 1; worker < numThreads; ++worker) {
+            threads.emplace_back([this, worker](std::stop_token stop) {
+                wait(stop, worker);
+            });
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    auto operator=(const WorkerPool &) -> WorkerPool & = delete;
+
+    [[nodiscard]] auto getThreadCount() const noexcept -> int
+    {
+        return static_cast<int>(threads.size()) + 1;
+    }
+
+    // Runs func(task, worker) for every task in [0, numTasks) like parallelFor(), with worker in
+    // [0, getThreadCount())
+    template <class F> auto run(int numTasks, F func) -> void
+    {
+        if (threads.empty() || numTasks <= 1) {
+            for (int task = 0; task < numTasks; ++task)
+                func(task, 0);
+            return;
+        }
+
+        tasks.reset(numTasks);
+        {
+            const std::lock_guard lock(mutex);
+            context = &func;
+            call = [](void *f, detail::TaskQueue &queue, int worker) {
+                queue.work(*static_cast<F *>(f), worker);
+            };
+            running = static_cast<int>(threads.size());
+            ++batch;
+        }
+        started.notify_all();
+
+        tasks.work(func, 0);
+
+        std::unique_lock lock(mutex);
+        finished.wait(lock, [&] { return running == 0; });
+        lock.unlock();
+        tasks.rethrow();
+    }
+
+private:
+    std::mutex                  mutex;
+    std::condition_variable_any started;
+    std::condition_variable     finished;
+    std::uint64_t               batch {0};
+    int                         running {0};
+    void                       *context {nullptr};
+    void (*call)(void *, detail::TaskQueue &, int) {nullptr};
+    detail::TaskQueue           tasks;
+
+    // Last, to stop before the rest is destroyed
+    std::vector<std::jthread> threads;
+
+    auto wait(const std::stop_token &stop, int worker) -> void
+    {
+        std::uint64_t done = 0;
+        while (true) {
+            std::unique_lock lock(mutex);
+            if (!started.wait(lock, stop, [&] { return batch != done; })) return;
+            done = batch;
+            lock.unlock();
+
+            call(context, tasks, worker);
+
+            lock.lock();
+            if (--running == 0) finished.notify_one();
+        }
+    }
+};
+
+// Selects the parallel overloads of Matrix operations, which run on up to threadCount threads
+// (0 = one per core). Work is split into bands of whole rows. Each band is processed in row-major
+// order, but bands run concurrently and in no particular order, so callbacks must be thread-safe.
+// Pure callbacks give the same results as the serial overloads.
+struct ParallelPolicy {
+    int threadCount {0};
+};
+
+// Runs func(yBegin, yEnd) over bands of rows covering [0, numRows), sized so each band holds a few
+// thousand elements of a row of rowLength
+template <class F>
+auto parallelForRows(int numRows, int rowLength, const ParallelPolicy &policy, F func) -> void
+{
+    static constexpr int bandElements = 16384;
+
+    const auto bandRows = std::max(1, bandElements / std::max(1, rowLength));
+    const auto numBands = (numRows + bandRows - 1) / bandRows;
+
+    parallelFor(numBands, policy.threadCount, [&](int band, int) {
+        const auto yBegin = band * bandRows;
+        func(yBegin, std::min(yBegin + bandRows, numRows));
+    });
+}
+
+} // namespace mist
+
+#endif
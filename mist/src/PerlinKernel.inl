@@ -0,0 +1,175 @@
+// Vectorized improved Perlin noise, evaluating Ops::width points at once.
+//
+// Included by Noise.cpp once per instruction set, inside a namespace holding the ops structs for
+// that instruction set and under a matching target pragma. Every step mirrors the scalar
+// BasicPerlinNoise2::evaluate(), operation for operation, so both paths round identically.
+
+template <class Ops> inline auto fade(typename Ops::V t) -> typename Ops::V
+{
+    // t * t * t * (t * (t * 6 - 15) + 10)
+    const auto t3 = Ops::mul(Ops::mul(t, t), t);
+    const auto poly = Ops::add(
+        Ops::mul(t, Ops::sub(Ops::mul(t, Ops::set(6)), Ops::set(15))), Ops::set(10));
+    return Ops::mul(t3, poly);
+}
+
+template <class Ops>
+inline auto lerp(typename Ops::V t, typename Ops::V a, typename Ops::V b) -> typename Ops::V
+{
+    return Ops::add(a, Ops::mul(t, Ops::sub(b, a)));
+}
+
+template <class Ops>
+inline auto grad(typename Ops::I hash, typename Ops::V x, typename Ops::V y, typename Ops::V z) ->
+    typename Ops::V
+{
+    const auto h = Ops::widen(Ops::andi(hash, Ops::seti(15)));
+
+    // h < 8 ? x : y
+    const auto isLow = Ops::cmpeqw(Ops::andw(h, Ops::setw(8)), Ops::setw(0));
+    const auto u = Ops::select(isLow, x, y);
+
+    // h < 4 ? y : h == 12 || h == 14 ? x : z
+    const auto isLower = Ops::cmpeqw(Ops::andw(h, Ops::setw(12)), Ops::setw(0));
+    const auto is12or14 = Ops::cmpeqw(Ops::andw(h, Ops::setw(13)), Ops::setw(12));
+    const auto v = Ops::select(isLower, y, Ops::select(is12or14, x, z));
+
+    return Ops::add(Ops::flipSign(Ops::template bitToSign<0>(h), u),
+                    Ops::flipSign(Ops::template bitToSign<1>(h), v));
+}
+
+// Mirrors OctaveStack::shape()
+template <class Ops> inline auto shape(typename Ops::V n, OctaveMode mode) -> typename Ops::V
+{
+    switch (mode) {
+    case OctaveMode::Ridged: {
+        const auto r = Ops::sub(Ops::set(1), Ops::abs(n));
+        return Ops::sub(Ops::mul(Ops::mul(r, r), Ops::set(2)), Ops::set(1));
+    }
+    case OctaveMode::Billow: return Ops::sub(Ops::mul(Ops::abs(n), Ops::set(2)), Ops::set(1));
+    default: return n;
+    }
+}
+
+// The z coordinate, shared by all points
+template <class Ops> struct PerlinZ {
+    typename Ops::I Z;
+    typename Ops::V z;
+    typename Ops::V z1;
+    typename Ops::V w;
+    bool            flat;
+
+    explicit PerlinZ(typename Ops::Scalar zOffset)
+    {
+        const auto zFloor = std::floor(zOffset);
+        Z = Ops::seti(static_cast<int>(zFloor) & 255);
+        z = Ops::set(zOffset - zFloor);
+        z1 = Ops::set(zOffset - zFloor - 1);
+        w = fade<Ops>(z);
+        flat = zOffset == zFloor;
+    }
+};
+
+template <class Ops>
+inline auto perlin(const std::uint8_t *perm, const PerlinZ<Ops> &zp, typename Ops::V x,
+                   typename Ops::V y) -> typename Ops::V
+{
+    using V = typename Ops::V;
+    using I = typename Ops::I;
+
+    const I one = Ops::seti(1);
+
+    // Find unit square that contains the point, and relative position within it
+    const V xFloor = Ops::floor(x);
+    const V yFloor = Ops::floor(y);
+    const I X = Ops::andi(Ops::toInt(xFloor), Ops::seti(255));
+    const I Y = Ops::andi(Ops::toInt(yFloor), Ops::seti(255));
+    x = Ops::sub(x, xFloor);
+    y = Ops::sub(y, yFloor);
+    const V x1 = Ops::sub(x, Ops::set(1));
+    const V y1 = Ops::sub(y, Ops::set(1));
+    const V z = zp.z;
+    const V z1 = zp.z1;
+
+    const V u = fade<Ops>(x);
+    const V v = fade<Ops>(y);
+
+    // Hash coordinates of cube corners
+    const I A = Ops::addi(Ops::gather(perm, X), Y);
+    const I AA = Ops::addi(Ops::gather(perm, A), zp.Z);
+    const I AB = Ops::addi(Ops::gather(perm, Ops::addi(A, one)), zp.Z);
+    const I B = Ops::addi(Ops::gather(perm, Ops::addi(X, one)), Y);
+    const I BA = Ops::addi(Ops::gather(perm, B), zp.Z);
+    const I BB = Ops::addi(Ops::gather(perm, Ops::addi(B, one)), zp.Z);
+
+    // Blend the face below the point, which is the whole result for integer z
+    // clang-format off
+    const V below =
+        lerp<Ops>(v,
+            lerp<Ops>(u, grad<Ops>(Ops::gather(perm, AA), x, y, z),
+                         grad<Ops>(Ops::gather(perm, BA), x1, y, z)),
+            lerp<Ops>(u, grad<Ops>(Ops::gather(perm, AB), x, y1, z),
+                         grad<Ops>(Ops::gather(perm, BB), x1, y1, z)));
+    if (zp.flat) return below;
+
+    const V above =
+        lerp<Ops>(v,
+            lerp<Ops>(u, grad<Ops>(Ops::gather(perm, Ops::addi(AA, one)), x, y, z1),
+                         grad<Ops>(Ops::gather(perm, Ops::addi(BA, one)), x1, y, z1)),
+            lerp<Ops>(u, grad<Ops>(Ops::gather(perm, Ops::addi(AB, one)), x, y1, z1),
+                         grad<Ops>(Ops::gather(perm, Ops::addi(BB, one)), x1, y1, z1)));
+    // clang-format on
+
+    return lerp<Ops>(zp.w, below, above);
+}
+
+// Samples the first points of 'points' into 'out', a multiple of Ops::width at a time. Returns the
+// number of points processed; the remainder is left for the scalar path.
+template <class Ops>
+auto perlinKernel(const std::uint8_t *perm, const Point2<typename Ops::Scalar> *points,
+                  typename Ops::Scalar zOffset, typename Ops::Scalar *out, std::size_t n)
+    -> std::size_t
+{
+    const PerlinZ<Ops> zp(zOffset);
+
+    std::size_t i = 0;
+    for (; i + Ops::width <= n; i += Ops::width) {
+        typename Ops::V x;
+        typename Ops::V y;
+        Ops::load(points + i, x, y);
+        Ops::store(out + i, perlin<Ops>(perm, zp, x, y));
+    }
+
+    return i;
+}
+
+// Like perlinKernel(), but sums all octaves at each point while it is in registers
+template <class Ops>
+auto perlinOctaveKernel(const std::uint8_t *perm, const Point2<typename Ops::Scalar> *points,
+                        typename Ops::Scalar zOffset,
+                        const OctaveStack<typename Ops::Scalar> &octaves,
+                        typename Ops::Scalar *out, std::size_t n) -> std::size_t
+{
+    const PerlinZ<Ops> zp(zOffset);
+    const auto         frequencies = octaves.frequencies();
+    const auto         amplitudes = octaves.amplitudes();
+    const auto         mode = octaves.getMode();
+
+    std::size_t i = 0;
+    for (; i + Ops::width <= n; i += Ops::width) {
+        typename Ops::V x;
+        typename Ops::V y;
+        Ops::load(points + i, x, y);
+
+        auto total = Ops::set(0);
+        for (std::size_t j = 0; j < frequencies.size(); ++j) {
+            const auto freq = Ops::set(frequencies[j]);
+            const auto noise = perlin<Ops>(perm, zp, Ops::mul(x, freq), Ops::mul(y, freq));
+            total = Ops::add(total, Ops::mul(Ops::set(amplitudes[j]), shape<Ops>(noise, mode)));
+        }
+
+        Ops::store(out + i, total);
+    }
+
+    return i;
+}
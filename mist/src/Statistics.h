@@ -0,0 +1,178 @@
+#ifndef STATISTICS_H_
+#define STATISTICS_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace mist
+{
+
+// Histogram of 'bins' bins evenly covering [low, high]. Values outside the range are counted in the
+// first or last bin. Without a range (high <= low), functions that can find the range of their
+// values use [min, max], and count every value in the first bin if min == max.
+struct HistogramBins {
+    int    bins {0};
+    double low {0};
+    double high {0};
+};
+
+// Summary of a set of numbers. min and max are only meaningful if count > 0, and NaNs give
+// unspecified results.
+template <typename T> struct Statistics {
+    T           min {};
+    T           max {};
+    double      sum {0};
+    std::size_t count {0};
+    double      sumSquaredDeviations {0}; // from the mean
+
+    // Empty unless requested, see HistogramBins
+    std::vector<std::size_t> histogram;
+
+    [[nodiscard]] auto mean() const -> double
+    {
+        return count ? sum / static_cast<double>(count) : 0.0;
+    }
+
+    // Population variance
+    [[nodiscard]] auto variance() const -> double
+    {
+        return count ? sumSquaredDeviations / static_cast<double>(count) : 0.0;
+    }
+};
+
+// Accumulates Statistics of spans of numbers. Spans are processed in independent lanes, so the
+// compiler can keep them in vector registers; sums are taken relative to the first value, which
+// keeps the variance accurate for values far from 0.
+template <typename T> class StatisticsAccumulator
+{
+    static_assert(std::is_arithmetic_v<T>, "Statistics need numbers");
+
+public:
+    StatisticsAccumulator() = default;
+
+    // Also counts a histogram, if 'bins_' has bins. Without a range, every value is counted in the
+    // first bin.
+    explicit StatisticsAccumulator(const HistogramBins &bins_)
+        : bins(bins_), histogram(static_cast<std::size_t>(std::max(bins_.bins, 0)))
+    {
+    }
+
+    auto add(std::span<const T> values) -> void
+    {
+        if (values.empty()) return;
+
+        if (count == 0) {
+            shift = static_cast<double>(values[0]);
+            mins.fill(values[0]);
+            maxs.fill(values[0]);
+        }
+        count += values.size();
+
+        const auto full = values.size() / lanes * lanes;
+        for (std::size_t i = 0; i < full; i += lanes) {
+            for (std::size_t j = 0; j < lanes; ++j) {
+                const auto v = values[i + j];
+                const auto d = static_cast<double>(v) - shift;
+                mins[j] = v < mins[j] ? v : mins[j];
+                maxs[j] = v > maxs[j] ? v : maxs[j];
+                sums[j] += d;
+                squares[j] += d * d;
+            }
+        }
+        for (auto i = full; i < values.size(); ++i) {
+            const auto v = values[i];
+            const auto d = static_cast<double>(v) - shift;
+            mins[0] = std::min(mins[0], v);
+            maxs[0] = std::max(maxs[0], v);
+            sums[0] += d;
+            squares[0] += d * d;
+        }
+
+        if (!histogram.empty()) addToHistogram(values);
+    }
+
+    // Combines the values added to 'other', as if they had been added here after ours
+    auto merge(const StatisticsAccumulator &other) -> void
+    {
+        if (other.count == 0) return;
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+
+        // bring other's sums to our shift: sum (d - k)^2 = sum d^2 - 2k sum d + n k^2
+        const auto k = shift - other.shift;
+        const auto n = static_cast<double>(other.count);
+        const auto otherSum = other.sumOfLanes(other.sums);
+        sums[0] += otherSum - n * k;
+        squares[0] += other.sumOfLanes(other.squares) - 2 * k * otherSum + n * k * k;
+
+        for (std::size_t j = 0; j < lanes; ++j) {
+            mins[j] = std::min(mins[j], other.mins[j]);
+            maxs[j] = std::max(maxs[j], other.maxs[j]);
+        }
+        for (std::size_t b = 0; b < histogram.size(); ++b)
+            histogram[b] += other.histogram[b];
+
+        count += other.count;
+    }
+
+    [[nodiscard]] auto result() const -> Statistics<T>
+    {
+        Statistics<T> s;
+        s.count = count;
+        if (count == 0) return s;
+
+        const auto n = static_cast<double>(count);
+        const auto d = sumOfLanes(sums);
+
+        s.min = *std::min_element(mins.begin(), mins.end());
+        s.max = *std::max_element(maxs.begin(), maxs.end());
+        s.sum = shift * n + d;
+        s.sumSquaredDeviations = std::max(0.0, sumOfLanes(squares) - d * d / n);
+        s.histogram = histogram;
+        return s;
+    }
+
+private:
+    static constexpr std::size_t lanes = 8;
+
+    HistogramBins             bins;
+    std::vector<std::size_t>  histogram;
+    std::size_t               count {0};
+    double                    shift {0};
+    std::array<T, lanes>      mins {};
+    std::array<T, lanes>      maxs {};
+    std::array<double, lanes> sums {};
+    std::array<double, lanes> squares {};
+
+    static auto sumOfLanes(const std::array<double, lanes> &a) -> double
+    {
+        double total = 0;
+        for (const auto v : a)
+            total += v;
+        return total;
+    }
+
+    auto addToHistogram(std::span<const T> values) -> void
+    {
+        const auto last = static_cast<double>(histogram.size() - 1);
+        const auto scale = bins.high > bins.low ? static_cast<double>(histogram.size()) /
+                                                      (bins.high - bins.low)
+                                                : 0.0;
+
+        for (const auto v : values) {
+            // written so NaNs land in the first bin
+            const auto bin = (static_cast<double>(v) - bins.low) * scale;
+            ++histogram[bin > 0 ? static_cast<std::size_t>(std::min(bin, last)) : 0];
+        }
+    }
+};
+
+} // namespace mist
+
+#endif
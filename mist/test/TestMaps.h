@@ -0,0 +1,49 @@
+#ifndef TESTMAPS_H_
+#define TESTMAPS_H_
+
+#include "Matrix.h"
+#include "Point.h"
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Map shared by the route finding tests, with hills above blockValue that routes go around
+namespace mist::test
+{
+
+inline constexpr auto    blockValue = 0.7;
+inline constexpr Point2i testMapSize {90, 70};
+
+template <class Layout = RowMajorLayout> auto makeTestMap() -> Matrix<double, Layout>
+{
+    Matrix<double, Layout> map(testMapSize.x, testMapSize.y);
+    map.generate([](const Point2i &p) {
+        return std::sin(p.x * 0.21) * std::cos(p.y * 0.13);
+    });
+    return map;
+}
+
+// 'count' pairs of points (from, to) spread over a map of 'size'
+inline auto makeTestQueries(int count, const Point2i &size = testMapSize)
+    -> std::vector<std::pair<Point2i, Point2i>>
+{
+    std::vector<std::pair<Point2i, Point2i>> queries;
+    for (int i = 0; i < count; ++i) {
+        queries.emplace_back(Point2i {i * 37 % size.x, i * 23 % size.y},
+                             Point2i {(i * 53 + 41) % size.x, (i * 31 + 17) % size.y});
+    }
+    return queries;
+}
+
+// Whether enough test queries had a route for a test to show anything. On the test map, more than
+// half of them do.
+inline auto mostReachable(int reachable, std::size_t count) -> bool
+{
+    return static_cast<std::size_t>(reachable) * 2 > count;
+}
+
+} // namespace mist::test
+
+#endif
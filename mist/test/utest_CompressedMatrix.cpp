@@ -0,0 +1,150 @@
+#include "CompressedMatrix.h"
+#include "Noise.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <utility>
+
+using namespace mist;
+
+TEST_CASE("LZ codec round trip", "[compressedmatrix]")
+{
+    std::mt19937 rng(42);
+
+    SECTION("Empty and short inputs")
+    {
+        for (std::size_t size : {0, 1, 3, 4, 5}) {
+            std::vector<std::uint8_t> input(size, 7);
+            CHECK(lzDecompress(lzCompress(input), size) == input);
+        }
+    }
+
+    SECTION("Random bytes")
+    {
+        std::vector<std::uint8_t> input(10000);
+        for (auto &b : input)
+            b = static_cast<std::uint8_t>(rng());
+        CHECK(lzDecompress(lzCompress(input), input.size()) == input);
+    }
+
+    SECTION("Repetitive bytes")
+    {
+        std::vector<std::uint8_t> input;
+        for (int i = 0; i < 100000; ++i)
+            input.push_back(static_cast<std::uint8_t>(i % 13 == 0 ? rng() % 4 : i % 7));
+
+        const auto compressed = lzCompress(input);
+        CHECK(compressed.size() < input.size() / 4);
+        CHECK(lzDecompress(compressed, input.size()) == input);
+    }
+
+    SECTION("Corrupt input")
+    {
+        const std::vector<std::uint8_t> input(1000, 1);
+        auto                            compressed = lzCompress(input);
+        CHECK_THROWS_AS(lzDecompress(compressed, input.size() + 1), std::runtime_error);
+
+        const auto truncated = std::span(compressed).first(compressed.size() - 2);
+        CHECK_THROWS(lzDecompress(truncated, input.size()));
+    }
+}
+
+TEST_CASE("Chunk packing round trip", "[compressedmatrix]")
+{
+    std::vector<std::uint64_t> values;
+    for (int y = 0; y < 10; ++y) {
+        for (int x = 0; x < 7; ++x)
+            values.push_back(static_cast<std::uint64_t>(x * 3 - y * 5) * 0x9e3779b97f4a7c15u);
+    }
+    values[20] = ~std::uint64_t {0};
+
+    std::vector<std::uint64_t> unpacked(values.size());
+    unpackChunk(packChunk(values, 7), unpacked, 7);
+    CHECK(unpacked == values);
+}
+
+TEST_CASE("Compressed matrix", "[compressedmatrix]")
+{
+    Matrix<double> heights(300, 170);
+    PerlinNoise2   perlin(0.5);
+    NoiseTextureBuilder2<double>(heights, perlin).setXScale(4).setYScale(4).build();
+
+    constexpr double step = 1.0 / 4096;
+    CompressedMatrix compressed(heights, step, 32);
+
+    REQUIRE(compressed.getSize() == heights.getSize());
+    CHECK(compressed.residentChunks() == 0);
+    CHECK(compressed.compressedSize() * 8 < 300 * 170 * sizeof(double));
+
+    SECTION("Values are quantized")
+    {
+        heights.foreachKeyValue([&](const Point2i &p, double v) {
+            CHECK(std::abs(compressed.at(p) - v) <= step / 2);
+        });
+        CHECK(compressed.residentChunks() == 10 * 6);
+        CHECK_THROWS_AS(compressed.at(300, 0), std::out_of_range);
+    }
+
+    SECTION("Chunks are decompressed on first access")
+    {
+        (void)compressed.at(40, 70);
+        (void)compressed.at(63, 95);
+        CHECK(compressed.residentChunks() == 1);
+        (void)compressed.at(299, 169);
+        CHECK(compressed.residentChunks() == 2);
+
+        compressed.evict();
+        CHECK(compressed.residentChunks() == 0);
+    }
+
+    SECTION("Modified chunks are compressed again")
+    {
+        compressed.at(5, 6) = 1000.0;
+        compressed.at(299, 169) = -3.0;
+        compressed.evict();
+
+        CHECK(compressed.at(5, 6) == 1000.0);
+        CHECK(compressed.at(299, 169) == -3.0);
+        CHECK(std::abs(compressed.at(7, 6) - heights.at(7, 6)) <= step / 2);
+    }
+
+    SECTION("Concurrent readers")
+    {
+        const auto reference = compressed.decompress();
+        compressed.evict();
+
+        std::vector<int> mismatches(4);
+        {
+            std::vector<std::jthread> threads;
+            for (int t = 0; t < 4; ++t) {
+                threads.emplace_back([&, t] {
+                    reference.foreachKeyValue([&](const Point2i &p, double v) {
+                        const auto &shared = std::as_const(compressed);
+                        mismatches[static_cast<size_t>(t)] += shared.at(p) != v;
+                    });
+                });
+            }
+        }
+        CHECK(mismatches == std::vector<int>(4, 0));
+    }
+}
+
+TEST_CASE("Compressed integer matrix is exact", "[compressedmatrix]")
+{
+    Matrix<std::int32_t> m(65, 33);
+    m.generate([](const Point2i &p) {
+        return p.x * p.x - 1000 * p.y + (p.x % 5 == 0 ? 1 << 30 : 0);
+    });
+
+    const CompressedMatrix compressed(m, 16, ParallelPolicy {3});
+    CHECK(compressed.decompress<TiledLayout<16>>().at(64, 32) == m.at(64, 32));
+    m.foreachKeyValue([&](const Point2i &p, std::int32_t v) {
+        CHECK(compressed.at(p) == v);
+    });
+
+    CHECK_THROWS_AS(CompressedMatrix<std::int32_t>(m, 48), std::invalid_argument);
+}
@@ -0,0 +1,149 @@
+#include "CowMatrix.h"
+#include "MapTools.h"
+#include "TestMaps.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace mist;
+using namespace mist::test;
+
+TEST_CASE("CowMatrix reads like a Matrix", "[cowmatrix]")
+{
+    const auto            map = makeTestMap();
+    CowMatrix<double, 16> cow(map);
+
+    CHECK(cow.getSize() == map.getSize());
+    map.foreachKeyValue([&](const Point2i &p, double v) {
+        CHECK(cow[p] == v);
+    });
+    CHECK_THROWS_AS(cow.at(90, 0), std::out_of_range);
+    CHECK_THROWS_AS(CowMatrix<int>(-1, 1), std::invalid_argument);
+
+    cow.transform([](double v) {
+        return v * 2;
+    });
+    CHECK(cow.at(10, 20) == map.at(10, 20) * 2);
+
+    cow.fill(3);
+    cow.at(89, 69) = 4;
+    CHECK(cow.at(0, 0) == 3);
+    CHECK(cow.at(89, 69) == 4);
+}
+
+TEST_CASE("Snapshots keep their values", "[cowmatrix]")
+{
+    CowMatrix<int, 16> cow(40, 20);
+    cow.generate([](const Point2i &p) {
+        return p.x + 100 * p.y;
+    });
+
+    const auto snapshot = cow.snapshot();
+    const auto copy = cow;
+    CHECK(snapshot.getRevision() == cow.getRevision());
+
+    // tiles are shared until written
+    CHECK(&snapshot.at(0, 0) == &std::as_const(cow).at(0, 0));
+
+    cow.at(5, 5) = -1;
+    CHECK(snapshot.at(5, 5) == 505);
+    CHECK(copy.at(5, 5) == 505);
+    CHECK(cow.at(5, 5) == -1);
+
+    // only the written tile was copied, and it's written in place from now on
+    CHECK(&snapshot.at(0, 0) != &std::as_const(cow).at(0, 0));
+    CHECK(&snapshot.at(20, 0) == &std::as_const(cow).at(20, 0));
+    const auto *inPlace = &std::as_const(cow).at(6, 6);
+    cow.at(6, 6) = -2;
+    CHECK(&std::as_const(cow).at(6, 6) == inPlace);
+
+    std::vector<std::pair<Point2i, Point2i>> modified;
+    cow.foreachModifiedTile(snapshot.getRevision(), [&](const Point2i &origin, const Point2i &s) {
+        modified.emplace_back(origin, s);
+    });
+    CHECK(modified == std::vector<std::pair<Point2i, Point2i>> {{{0, 0}, {16, 16}}});
+
+    cow.fill(7);
+    CHECK(snapshot.at(39, 19) == 39 + 1900);
+    CHECK(copy.at(39, 19) == 39 + 1900);
+}
+
+TEST_CASE("Snapshots are consistent while the matrix changes", "[cowmatrix]")
+{
+    CowMatrix<int, 8> cow(64, 64);
+
+    std::mutex             mutex;
+    MatrixSnapshot<int, 8> latest = cow.snapshot();
+    std::atomic<bool>      done {false};
+    std::atomic<int>       inconsistent {0};
+
+    // every snapshot holds a single value
+    std::thread reader([&] {
+        while (!done) {
+            MatrixSnapshot<int, 8> snapshot;
+            {
+                const std::lock_guard lock(mutex);
+                snapshot = latest;
+            }
+
+            const auto first = snapshot.getSize() == Point2i {0, 0} ? 0 : snapshot[{0, 0}];
+            snapshot.foreachValue([&](int v) {
+                if (v != first) ++inconsistent;
+            });
+        }
+    });
+
+    for (int i = 1; i <= 200; ++i) {
+        cow.fill(i);
+        const auto snapshot = cow.snapshot();
+
+        const std::lock_guard lock(mutex);
+        latest = snapshot;
+    }
+    done = true;
+    reader.join();
+
+    CHECK(inconsistent == 0);
+}
+
+TEST_CASE("MapTools run on snapshots", "[cowmatrix]")
+{
+    const auto        map = makeTestMap();
+    CowMatrix<double> cow(map);
+    const auto        snapshot = cow.snapshot();
+    cow.fill(0);
+
+    SECTION("Gradient")
+    {
+        const auto                     expected = calculateGradient(map);
+        Matrix<Point2d, TiledLayout<>> grad(snapshot.getSize());
+        calculateGradient(snapshot, grad);
+
+        expected.foreachKeyValue([&](const Point2i &p, const Point2d &v) {
+            CHECK(grad.at(p) == v);
+        });
+    }
+
+    SECTION("AStar")
+    {
+        AStar<double> expected(map);
+        AStar         star(snapshot);
+        expected.setBlockValue(blockValue).calculate({5, 5});
+        star.setBlockValue(blockValue).calculate({5, 5});
+
+        CHECK(star.route({80, 60}) == expected.route({80, 60}));
+    }
+
+    SECTION("Statistics")
+    {
+        CachedStatistics stats(snapshot);
+        CHECK(stats.get().min == statistics(map).min);
+        CHECK(stats.get().max == statistics(map).max);
+    }
+}
@@ -0,0 +1,116 @@
+#include "FlowField.h"
+#include "TestMaps.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace mist;
+using namespace mist::test;
+using namespace Catch::Matchers;
+
+namespace
+{
+
+// Checks that both fields have the same costs, up to rounding
+auto checkSameCosts(const FlowField<double> &field, const FlowField<double> &expected) -> void
+{
+    expected.getCost().foreachKeyValue([&](const Point2i &p, double v) {
+        REQUIRE(field.canReach(p) == expected.canReach(p));
+        if (expected.canReach(p)) CHECK_THAT(field.getCost().at(p), WithinRel(v, 1e-9));
+    });
+}
+
+} // namespace
+
+TEST_CASE("FlowField leads to the nearest goal", "[flowfield]")
+{
+    const auto                 map = makeTestMap();
+    const auto                 offset = 1 - std::min(0.0, statistics(map).min);
+    const std::vector<Point2i> goals {{10, 10}, {80, 60}, {45, 5}};
+
+    FlowField<double> field(map);
+    AStar<double>     expected(map);
+    field.setBlockValue(blockValue);
+    expected.setBlockValue(blockValue);
+
+    CHECK_THROWS_AS(field.update(), std::logic_error);
+    CHECK_THROWS_AS(field.calculate({{90, 0}}), std::out_of_range);
+    field.calculate(goals);
+    CHECK_THROWS_AS(field.next({0, 70}), std::out_of_range);
+
+    const auto queries = makeTestQueries(60);
+    int        reachable = 0;
+    for (const auto &query : queries) {
+        const auto from = query.first;
+        expected.calculate(from);
+
+        auto nearest = std::numeric_limits<double>::max();
+        for (const auto &g : goals)
+            nearest = std::min(nearest, expected.getCost().at(g));
+
+        REQUIRE(field.canReach(from) == (nearest < std::numeric_limits<double>::max()));
+        if (!field.canReach(from)) {
+            CHECK(field.next(from) == from);
+            continue;
+        }
+        CHECK_THAT(field.getCost().at(from), WithinRel(nearest, 1e-9));
+
+        // following the directions costs as much
+        auto p = from;
+        auto cost = 0.0;
+        for (int steps = 0; std::find(goals.begin(), goals.end(), p) == goals.end(); ++steps) {
+            REQUIRE(steps < 90 * 70);
+
+            const auto q = field.next(p);
+            CHECK(field.getDirections().at(p) == q - p);
+            REQUIRE(std::abs(q.x - p.x) + std::abs(q.y - p.y) == 1);
+            REQUIRE_FALSE(map.at(q) > blockValue);
+            cost += map.at(q) + offset;
+            p = q;
+        }
+        CHECK(field.next(p) == p);
+        CHECK_THAT(cost, WithinRel(nearest, 1e-9));
+        ++reachable;
+    }
+    CHECK(mostReachable(reachable, queries.size()));
+}
+
+TEST_CASE("FlowField follows moving goals and changes to the map", "[flowfield]")
+{
+    auto map = makeTestMap();
+    map.trackModifiedTiles(8);
+
+    FlowField<double> field(map);
+    FlowField<double> expected(map);
+    field.setBlockValue(blockValue);
+    expected.setBlockValue(blockValue);
+
+    field.calculate({{10, 10}, {80, 60}, {45, 5}});
+
+    // one goal moves a little, and only its part of the field is calculated again
+    const std::vector<Point2i> goals {{10, 10}, {78, 61}, {45, 5}};
+    field.update(goals);
+    expected.calculate(goals);
+    checkSameCosts(field, expected);
+    CHECK(field.getExpansions() < expected.getExpansions());
+
+    // a wall with one opening
+    for (int y = 0; y < 70; ++y) {
+        if (y < 30 || y > 32) map.at(60, y) = 1;
+    }
+    field.update();
+    expected.calculate(goals);
+    checkSameCosts(field, expected);
+
+    // ...opened again
+    map.at(60, 5) = 0;
+    field.update();
+    expected.calculate(goals);
+    checkSameCosts(field, expected);
+}
@@ -0,0 +1,92 @@
+#include "HierarchicalAStar.h"
+#include "TestMaps.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+using namespace mist;
+using namespace mist::test;
+
+namespace
+{
+
+// Cost of a route with the steps of AStar, or -1 if it isn't a route from 'from' to 'to'
+auto routeCost(const Matrix<double> &map, const std::vector<Point2i> &route, const Point2i &from,
+               const Point2i &to) -> double
+{
+    if (route.empty() || route.front() != from || route.back() != to) return -1;
+
+    const auto offset = 1 - std::min(0.0, statistics(map).min);
+    auto       cost = 0.0;
+    for (std::size_t i = 1; i < route.size(); ++i) {
+        const auto d = route[i] - route[i - 1];
+        if (std::abs(d.x) + std::abs(d.y) != 1 || map.at(route[i]) > blockValue) return -1;
+
+        cost += map.at(route[i]) + offset;
+    }
+    return cost;
+}
+
+} // namespace
+
+TEST_CASE("HierarchicalAStar finds routes wherever AStar does", "[hpa]")
+{
+    const auto                map = makeTestMap();
+    HierarchicalAStar<double> star(map, 8);
+    AStar<double>             expected(map);
+    star.setBlockValue(blockValue);
+    expected.setBlockValue(blockValue);
+
+    CHECK_THROWS_AS(star.route({0, 0}, {90, 0}), std::out_of_range);
+    CHECK_THROWS_AS(HierarchicalAStar<double>(map, 1), std::invalid_argument);
+    CHECK_THROWS_AS(HierarchicalAStar<double>(map, 0), std::invalid_argument);
+
+    const auto queries = makeTestQueries(40);
+    int        reachable = 0;
+    for (const auto &[from, to] : queries) {
+        expected.calculate(from);
+
+        const auto route = star.route(from, to);
+        if (!expected.canReach(to)) {
+            CHECK(route.empty());
+            continue;
+        }
+
+        // close to the cheapest route
+        const auto cost = routeCost(map, route, from, to);
+        CHECK(cost >= expected.getCost().at(to));
+        CHECK(cost <= expected.getCost().at(to) * 1.25);
+        ++reachable;
+    }
+    CHECK(mostReachable(reachable, queries.size()));
+}
+
+TEST_CASE("HierarchicalAStar rebuilds the clusters around changes", "[hpa]")
+{
+    auto map = makeTestMap();
+    map.trackModifiedTiles(8);
+
+    HierarchicalAStar<double> star(map, 8);
+    star.setBlockValue(blockValue);
+    const Point2i from {5, 35};
+    const Point2i to {85, 35};
+    CHECK(routeCost(map, star.route(from, to), from, to) > 0);
+
+    // a wall with one opening, and another part of the map
+    for (int y = 0; y < 70; ++y) {
+        if (y < 60 || y > 62) map.at(45, y) = 1;
+    }
+    map.at(10, 10) = -0.5;
+
+    HierarchicalAStar<double> rebuilt(map, 8);
+    rebuilt.setBlockValue(blockValue);
+
+    const auto route = star.route(from, to);
+    CHECK(route == rebuilt.route(from, to));
+    CHECK(routeCost(map, route, from, to) > 0); // through the opening
+}
@@ -0,0 +1,474 @@
+#include "MapTools.h"
+#include "TestMaps.h"
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <latch>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace mist;
+using namespace mist::test;
+using namespace Catch::Matchers;
+
+TEST_CASE("DiamondSquare needs a square 2^n + 1 matrix", "[maptools]")
+{
+    Matrix<double> good(17, 17);
+    Matrix<double> wide(17, 9);
+    Matrix<double> odd(18, 18);
+
+    CHECK_NOTHROW(DiamondSquare(good).build());
+    CHECK_THROWS_AS(DiamondSquare(wide), std::invalid_argument);
+    CHECK_THROWS_AS(DiamondSquare(odd), std::invalid_argument);
+
+    good.foreachValue([](double v) {
+        CHECK(v >= -1.0);
+        CHECK(v <= 1.0);
+    });
+}
+
+TEMPLATE_TEST_CASE("MapTools results don't depend on the matrix layout", "[maptools]",
+                   PaddedRowLayout<64>, TiledLayout<16>, MortonLayout<32>)
+{
+    const auto expected = makeTestMap();
+    const auto map = makeTestMap<TestType>();
+
+    SECTION("Gradient")
+    {
+        const auto expectedGrad = calculateGradient(expected);
+        const auto grad = calculateGradient(map);
+
+        expectedGrad.foreachKeyValue([&](const Point2i &p, const Point2d &v) {
+            CHECK(grad.at(p) == v);
+        });
+    }
+
+    SECTION("AStar")
+    {
+        AStar<double>           expectedStar(expected);
+        AStar<double, TestType> star(map);
+        expectedStar.setBlockValue(blockValue).calculate({5, 5});
+        star.setBlockValue(blockValue).calculate({5, 5});
+
+        expectedStar.getCost().foreachKeyValue([&](const Point2i &p, double v) {
+            CHECK(star.getCost().at(p) == v);
+        });
+        CHECK(star.route({80, 60}) == expectedStar.route({80, 60}));
+    }
+}
+
+TEST_CASE("AStar follows changes to the map", "[maptools]")
+{
+    Matrix<double> map(20, 20);
+    map.fill(0);
+
+    AStar<double> star(map);
+    star.calculate({0, 0});
+    CHECK(star.getCost().at(19, 0) == 19);
+
+    // lowering the map minimum changes the cost offset of every step
+    map.at(10, 10) = -2;
+    star.calculate({0, 0});
+    CHECK(star.getCost().at(19, 0) == 19 * 3);
+}
+
+TEST_CASE("AStar follows a map that is assigned to", "[maptools]")
+{
+    auto          map = makeTestMap();
+    AStar<double> star(map);
+    star.setBlockValue(blockValue).calculate({5, 5});
+
+    // the new values come with new storage
+    Matrix<double> other(testMapSize);
+    other.generate([](const Point2i &p) {
+        return std::cos(p.x * 0.17) * std::sin(p.y * 0.11);
+    });
+    map = std::move(other);
+    star.update();
+
+    AStar<double> expected(map);
+    expected.setBlockValue(blockValue).calculate({5, 5});
+    CHECK(star.route({80, 60}) == expected.route({80, 60}));
+    CHECK(star.getCost().at(80, 60) == expected.getCost().at(80, 60));
+
+    map = Matrix<double>(10, 10);
+    CHECK_THROWS_AS(star.update(), std::logic_error);
+}
+
+TEST_CASE("AStar costs can be read from several threads", "[maptools]")
+{
+    const auto map = makeTestMap();
+
+    AStar<double> star(map);
+    star.setBlockValue(blockValue).calculate({5, 5});
+
+    // the first calls come at once
+    std::vector<double> costs(4);
+    std::latch          started(4);
+    parallelFor(4, 4, [&](int task, int) {
+        started.arrive_and_wait();
+        costs[static_cast<std::size_t>(task)] = star.getCost().at(80, 60);
+    });
+
+    AStar<double> expected(map);
+    expected.setBlockValue(blockValue).calculate({5, 5});
+    for (const auto c : costs)
+        CHECK(c == expected.getCost().at(80, 60));
+}
+
+TEST_CASE("AStar can be copied", "[maptools]")
+{
+    const auto map = makeTestMap();
+
+    AStar<double> star(map);
+    star.setBlockValue(blockValue).calculate({5, 5});
+    const auto expected = star.getCost().at(80, 60);
+
+    // with and without costs filled
+    AStar<double> copy(star);
+    CHECK(copy.getCost().at(80, 60) == expected);
+    CHECK(copy.route({80, 60}) == star.route({80, 60}));
+
+    copy.calculate({80, 60});
+    star = copy;
+    CHECK(star.getCost().at(5, 5) == copy.getCost().at(5, 5));
+    CHECK(star.route({5, 5}) == copy.route({5, 5}));
+}
+
+TEST_CASE("AStar with a target finds the same routes", "[maptools]")
+{
+    const auto map = makeTestMap();
+
+    AStar<double> full(map);
+    AStar<double> targeted(map);
+    full.setBlockValue(blockValue).calculate({5, 5});
+    targeted.setBlockValue(blockValue);
+
+    for (const auto &to : {Point2i {80, 60}, Point2i {5, 6}, Point2i {40, 10}, Point2i {5, 5}}) {
+        targeted.calculate({5, 5}, to);
+        CHECK(targeted.getCost().at(to) == full.getCost().at(to));
+        CHECK(targeted.route(to) == full.route(to));
+    }
+
+    // a close target leaves far points unexplored
+    targeted.calculate({5, 5}, {5, 6});
+    CHECK_FALSE(targeted.canReach({80, 60}));
+    CHECK_THROWS_AS(targeted.calculate({5, 5}, {90, 0}), std::out_of_range);
+}
+
+TEST_CASE("AStar expands only jump points when steps cost the same", "[maptools]")
+{
+    // rooms with a door in each wall, and pillars
+    Matrix<double> map(121, 121);
+    map.generate([](const Point2i &p) {
+        const auto wall = p.x % 20 == 0 || p.y % 20 == 0;
+        const auto door = (p.x % 20 == 0 && p.y % 20 == 10) || (p.y % 20 == 0 && p.x % 20 == 7);
+        const auto pillar = p.x % 20 == 13 && p.y % 20 > 4 && p.y % 20 < 9;
+        return (wall && !door) || pillar ? 1.0 : 0.0;
+    });
+
+    AStar<double> jumping(map);
+    AStar<double> expected(map);
+    jumping.setBlockValue(0.5);
+    expected.setBlockValue(0.5).setJumpPoints(false);
+
+    std::size_t jumpingExpansions = 0;
+    std::size_t expectedExpansions = 0;
+    for (const auto &[from, to] : {std::pair {Point2i {3, 3}, Point2i {115, 112}},
+                                   std::pair {Point2i {50, 45}, Point2i {51, 44}},
+                                   std::pair {Point2i {95, 5}, Point2i {8, 118}}}) {
+        jumping.calculate(from, to);
+        expected.calculate(from, to);
+
+        CHECK(jumping.getCost().at(to) == expected.getCost().at(to));
+        jumpingExpansions += jumping.getExpansions();
+        expectedExpansions += expected.getExpansions();
+
+        const auto route = jumping.route(to);
+        CHECK(route.size() == expected.route(to).size());
+        CHECK(route.front() == to);
+        CHECK(route.back() == from);
+        CHECK(std::adjacent_find(route.begin(), route.end(),
+                                 [&](const Point2i &a, const Point2i &b) {
+                                     return std::abs(a.x - b.x) + std::abs(a.y - b.y) != 1 ||
+                                            map.at(b) > 0.5;
+                                 }) == route.end());
+    }
+    CHECK(jumpingExpansions * 10 < expectedExpansions);
+
+    // a wall without doors
+    map.foreachKey([&](const Point2i &p) {
+        if (p.x == 60) map.at(p) = 1;
+    });
+    jumping.calculate({3, 3}, {115, 112});
+    CHECK_FALSE(jumping.canReach({115, 112}));
+    CHECK(jumping.route({115, 112}).empty());
+}
+
+TEST_CASE("AStar routes move diagonally or at any angle", "[maptools]")
+{
+    Matrix<double> flat(40, 30);
+    flat.fill(0);
+    flat.trackModifiedTiles(8);
+
+    AStar<double>        star(flat);
+    std::vector<Point2i> route;
+    star.setMoves(RouteMoves::Diagonal).calculate({0, 0});
+    CHECK_THAT(star.getCost().at(30, 20), WithinRel(20 * std::sqrt(2.0) + 10, 1e-12));
+
+    // moves set since the last calculation apply to updates
+    star.setMoves(RouteMoves::Cardinal).calculate({0, 0});
+    star.setMoves(RouteMoves::Diagonal);
+    flat.at(39, 0) = 0;
+    star.update();
+    CHECK_THAT(star.getCost().at(30, 20), WithinRel(20 * std::sqrt(2.0) + 10, 1e-12));
+    star.route({30, 20}, route);
+    CHECK(route.size() == 31);
+
+    // costs of diagonal moves, but straight routes
+    star.setMoves(RouteMoves::AnyAngle).calculate({0, 0}, {30, 20});
+    CHECK_THAT(star.getCost().at(30, 20), WithinRel(20 * std::sqrt(2.0) + 10, 1e-12));
+    star.route({30, 20}, route);
+    CHECK(route == std::vector<Point2i> {{30, 20}, {0, 0}});
+
+    auto map = makeTestMap();
+    map.trackModifiedTiles(8);
+    const Point2i from {5, 5};
+    const Point2i to {80, 60};
+    const auto    blocked = [&](const Point2i &p) {
+        return std::as_const(map).at(p) > blockValue;
+    };
+
+    AStar<double> cardinal(map);
+    AStar<double> diagonal(map);
+    AStar<double> anyAngle(map);
+    cardinal.setBlockValue(blockValue).calculate(from);
+    diagonal.setBlockValue(blockValue).setMoves(RouteMoves::Diagonal).calculate(from);
+    anyAngle.setBlockValue(blockValue).setMoves(RouteMoves::AnyAngle).calculate(from, to);
+    REQUIRE(cardinal.canReach(to));
+    CHECK(diagonal.getCost().at(to) < cardinal.getCost().at(to));
+    CHECK(anyAngle.getCost().at(to) < cardinal.getCost().at(to));
+
+    // diagonal steps don't pass blocked points
+    const auto diagonalRoute = diagonal.route(to);
+    CHECK(diagonalRoute.front() == to);
+    CHECK(diagonalRoute.back() == from);
+    CHECK(std::adjacent_find(diagonalRoute.begin(), diagonalRoute.end(),
+                             [&](const Point2i &a, const Point2i &b) {
+                                 return std::max(std::abs(a.x - b.x), std::abs(a.y - b.y)) != 1 ||
+                                        blocked(b) || blocked({a.x, b.y}) || blocked({b.x, a.y});
+                             }) == diagonalRoute.end());
+
+    // any-angle routes turn at few points, which see each other
+    const auto anyAngleRoute = anyAngle.route(to);
+    CHECK(anyAngleRoute.front() == to);
+    CHECK(anyAngleRoute.back() == from);
+    CHECK(anyAngleRoute.size() * 4 < diagonalRoute.size());
+    for (std::size_t k = 1; k < anyAngleRoute.size(); ++k) {
+        const auto a = static_cast<Point2d>(anyAngleRoute[k - 1]);
+        const auto b = static_cast<Point2d>(anyAngleRoute[k]);
+        for (int t = 0; t <= 100; ++t)
+            CHECK_FALSE(blocked(round(a + (b - a) * (t / 100.0))));
+    }
+
+    // updates with diagonal steps
+    for (int y = 0; y < 70; ++y) {
+        if (y < 30 || y > 32) map.at(45, y) = 1;
+    }
+    diagonal.update();
+    AStar<double> expected(map);
+    expected.setBlockValue(blockValue).setMoves(RouteMoves::Diagonal).calculate(from);
+    expected.getCost().foreachKeyValue([&](const Point2i &p, double v) {
+        REQUIRE(diagonal.canReach(p) == expected.canReach(p));
+        if (expected.canReach(p)) CHECK_THAT(diagonal.getCost().at(p), WithinRel(v, 1e-9));
+    });
+
+    // a close target leaves far points unexplored
+    diagonal.calculate(from, {5, 6});
+    CHECK(diagonal.route(to).empty());
+    CHECK_THROWS_AS(diagonal.route({90, 0}), std::out_of_range);
+}
+
+TEST_CASE("ParallelRoutes finds the routes of AStar", "[maptools]")
+{
+    const auto map = makeTestMap();
+    const auto offset = 1 - std::min(0.0, statistics(map).min);
+
+    auto queries = makeTestQueries(40);
+
+    ParallelRoutes<double> parallel(map, 4);
+    AStar<double>          expected(map);
+    parallel.setBlockValue(blockValue);
+    expected.setBlockValue(blockValue);
+
+    std::vector<std::vector<Point2i>> routes;
+    parallel.routesFromTo(queries, routes);
+    REQUIRE(routes.size() == queries.size());
+
+    int reachable = 0;
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        const auto &[from, to] = queries[i];
+        const auto &route = routes[i];
+        expected.calculate(from);
+
+        if (!expected.canReach(to)) {
+            CHECK(route.empty());
+            continue;
+        }
+        REQUIRE_FALSE(route.empty());
+        CHECK(route.front() == from);
+        CHECK(route.back() == to);
+
+        auto cost = 0.0;
+        for (std::size_t k = 1; k < route.size(); ++k) {
+            const auto d = route[k] - route[k - 1];
+            CHECK(std::abs(d.x) + std::abs(d.y) == 1);
+            cost += map.at(route[k]) + offset;
+        }
+        CHECK_THAT(cost, WithinRel(expected.getCost().at(to), 1e-9));
+        ++reachable;
+    }
+    CHECK(mostReachable(reachable, queries.size()));
+
+    // the same routes again on one thread, into the same vectors
+    ParallelRoutes<double> serial(map, 1);
+    serial.setBlockValue(blockValue);
+    CHECK(serial.routesFromTo(queries) == routes);
+    parallel.routesFromTo(queries, routes);
+    CHECK(serial.routesFromTo(queries) == routes);
+
+    queries.emplace_back(Point2i {0, 0}, Point2i {0, 70});
+    CHECK_THROWS_AS(parallel.routesFromTo(queries), std::out_of_range);
+}
+
+TEST_CASE("Incremental updates follow brush strokes", "[maptools]")
+{
+    auto map = makeTestMap();
+    map.trackModifiedTiles(16);
+
+    auto grad = calculateGradient(map);
+    auto gradRevision = map.getRevision();
+
+    AStar<double> star(map);
+    CHECK_THROWS_AS(star.update(), std::logic_error);
+    star.setBlockValue(blockValue).calculate({5, 5});
+
+    MapBrush   brush(map, 4);
+    const auto mismatches = [](const auto &a, const auto &b) {
+        int count = 0;
+        a.foreachKeyValue([&](const Point2i &p, const auto &v) {
+            count += b.at(p) != v;
+        });
+        return count;
+    };
+
+    // each stroke is compared to a full calculation
+    const auto strokeAndCheck = [&](const std::vector<Point2i> &points, double amount) {
+        brush.atPoints(points, [&](const Point2i &p, double r) {
+            map[p] += amount * std::max(0.0, 1.0 - r / 4);
+        });
+
+        gradRevision = updateGradient(map, grad, gradRevision);
+        CHECK(mismatches(grad, calculateGradient(map)) == 0);
+
+        AStar<double> expected(map);
+        expected.setBlockValue(blockValue).calculate({5, 5});
+        star.update();
+        CHECK(mismatches(star.getCost(), expected.getCost()) == 0);
+    };
+
+    strokeAndCheck({{30, 30}, {33, 33}}, 2.0); // wall across routes
+    strokeAndCheck({{30, 30}}, -2.0);          // opening in the wall
+    strokeAndCheck({{60, 40}, {10, 60}}, -0.3);
+    strokeAndCheck({{6, 6}, {85, 65}}, 0.5);
+
+    // a new minimum changes every step
+    map.at(0, 69) = -5;
+    AStar<double> expected(map);
+    expected.setBlockValue(blockValue).calculate({5, 5});
+    star.update();
+    CHECK(star.getCost().at(80, 60) == expected.getCost().at(80, 60));
+}
+
+TEST_CASE("A brush follows its matrix when it's assigned to", "[maptools]")
+{
+    Matrix<double> map(10, 10);
+    MapBrush       brush(map, 2);
+    map = Matrix<double>(30, 20);
+
+    std::vector<Point2i> painted;
+    brush.atPoints(std::vector {Point2i {25, 15}}, [&](const Point2i &p, double) {
+        painted.push_back(p);
+    });
+    CHECK(painted.size() == 5 * 5);
+}
+
+TEST_CASE("MapTools work on views like on copies", "[maptools]")
+{
+    auto          map = makeTestMap();
+    const Point2i origin {17, 11};
+    const Point2i size {40, 30};
+
+    Matrix<double> copy(size);
+    copy.generate([&](const Point2i &p) {
+        return map.at(p + origin);
+    });
+
+    const MatrixView view(map, origin, size);
+
+    SECTION("Gradient")
+    {
+        const auto expected = calculateGradient(copy);
+        const auto grad = calculateGradient(view);
+
+        expected.foreachKeyValue([&](const Point2i &p, const Point2d &v) {
+            CHECK(grad.at(p) == v);
+        });
+    }
+
+    SECTION("AStar")
+    {
+        AStar<double> expected(copy);
+        AStar<double> star(view);
+        expected.setBlockValue(blockValue).calculate({5, 5});
+        star.setBlockValue(blockValue).calculate({5, 5});
+
+        CHECK(star.route({35, 25}) == expected.route({35, 25}));
+    }
+
+    SECTION("Flood fill")
+    {
+        std::set<Point2i> expected;
+        std::set<Point2i> filled;
+        floodFill(copy, {20, 15}, 12.0, 0.2, [&](const Point2i &p) {
+            expected.insert(p);
+        });
+        floodFill(view, {20, 15}, 12.0, 0.2, [&](const Point2i &p) {
+            filled.insert(p);
+        });
+
+        CHECK(filled == expected);
+    }
+
+    SECTION("Brush")
+    {
+        std::vector<Point2i> painted;
+        MapBrush             brush(view, 3);
+        brush.atPoints(std::vector {Point2i {1, 1}}, [&](const Point2i &p, double) {
+            painted.push_back(p);
+        });
+
+        // clipped to the view, not to the map
+        CHECK(painted.size() == 5 * 5);
+        CHECK(std::all_of(painted.begin(), painted.end(), [&](const Point2i &p) {
+            return view.contains(p);
+        }));
+    }
+}
@@ -2,8 +2,17 @@
 #include "Point.h"
 
 #include <catch2/catch_approx.hpp>
+#include <catch2/catch_template_test_macros.hpp>
 #include <catch2/catch_test_macros.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
 using namespace mist;
 
 TEST_CASE("Matrix accessors", "[utils]")
@@ -86,3 +95,570 @@ TEST_CASE("Matrix min/max", "[utils]")
     CHECK(min(cm) == -5);
     CHECK(max(cm) == 88);
 }
+
+TEST_CASE("Matrix unchecked access and rows", "[utils]")
+{
+    Matrix<int> m(4, 3);
+    m.generate([](const Point2i &p) {
+        return p.y * 10 + p.x;
+    });
+
+    CHECK(m[Point2i {3, 2}] == 23);
+    m[Point2i {1, 2}] = -1;
+    CHECK(m.at(1, 2) == -1);
+
+    const auto row = m.row(1);
+    REQUIRE(row.size() == 4);
+    CHECK(row[0] == 10);
+    CHECK(row[3] == 13);
+
+    row[2] = 99;
+    CHECK(m.at(2, 1) == 99);
+
+    const Matrix<int> &cm = m;
+    CHECK(cm.row(2)[1] == -1);
+    CHECK(cm[Point2i {0, 0}] == 0);
+}
+
+TEST_CASE("Parallel Matrix operations match serial ones", "[utils]")
+{
+    const ParallelPolicy parallel {4};
+
+    auto generator = [](const Point2i &p) {
+        return p.x * 7 - p.y * 3;
+    };
+
+    Matrix<int> serial(300, 211);
+    Matrix<int> m(300, 211);
+    serial.generate(generator);
+    m.generate(parallel, generator);
+
+    auto check = [&] {
+        serial.foreachKeyValue([&](const Point2i &p, int v) {
+            REQUIRE(m.at(p) == v);
+        });
+    };
+    check();
+
+    auto twicePlusOne = [](int i) {
+        return i * 2 + 1;
+    };
+    serial.transform(twicePlusOne);
+    m.transform(parallel, twicePlusOne);
+    check();
+
+    auto minusFive = [](int &i) {
+        i -= 5;
+    };
+    serial.foreachValue(minusFive);
+    m.foreachValue(parallel, minusFive);
+    check();
+
+    const auto halves = transformMatrix<int, double>(parallel, m, [](int i) {
+        return i / 2.0;
+    });
+    halves.foreachKeyValue([&](const Point2i &p, double v) {
+        REQUIRE(v == serial.at(p) / 2.0);
+    });
+
+    m.fill(parallel, 3);
+    CHECK(min(m) == 3);
+    CHECK(max(m) == 3);
+}
+
+TEST_CASE("Parallel Matrix foreach visits every key once", "[utils]")
+{
+    // Catch assertions aren't thread-safe, so the callbacks only count
+    Matrix<std::atomic<int>> visits(130, 260);
+    const auto              &cm = visits;
+    std::atomic<int>         misplaced {0};
+    std::atomic<int>         ones {0};
+
+    cm.foreachKey(ParallelPolicy {3}, [&](const Point2i &p) {
+        ++visits.at(p);
+    });
+    cm.foreachKeyValue(ParallelPolicy {3}, [&](const Point2i &p, const std::atomic<int> &v) {
+        if (&v != &visits.at(p)) ++misplaced;
+    });
+    cm.foreachValue(ParallelPolicy {}, [&](const std::atomic<int> &v) {
+        if (v == 1) ++ones;
+    });
+
+    CHECK(misplaced == 0);
+    CHECK(ones == 130 * 260);
+}
+
+TEMPLATE_TEST_CASE("Matrix layouts", "[utils]", TiledLayout<8>, TiledLayout<64>, MortonLayout<8>,
+                   MortonLayout<64>)
+{
+    const Point2i size {77, 19};
+
+    SECTION("Layouts map points to distinct indices inside the storage")
+    {
+        const TestType   layout(size, sizeof(int));
+        std::vector<int> used(layout.storageSize());
+
+        for (auto y = 0; y < size.y; ++y) {
+            for (auto x = 0; x < size.x; ++x) {
+                const auto i = layout.index(x, y);
+                REQUIRE(i < used.size());
+                REQUIRE(used[i]++ == 0);
+            }
+        }
+    }
+
+    SECTION("Matrix behaves like the row-major one")
+    {
+        auto generator = [](const Point2i &p) {
+            return p.y * 1000 + p.x;
+        };
+
+        Matrix<int>           expected(size);
+        Matrix<int, TestType> m(size);
+        expected.generate(generator);
+        m.generate(generator);
+
+        std::vector<Point2i> keys;
+        std::vector<Point2i> expectedKeys;
+        m.foreachKeyValue([&](const Point2i &p, int v) {
+            CHECK(v == generator(p));
+            keys.push_back(p);
+        });
+        expected.foreachKey([&](const Point2i &p) {
+            expectedKeys.push_back(p);
+        });
+        CHECK(keys == expectedKeys);
+
+        m.transform([](int i) {
+            return -i;
+        });
+        CHECK(m.at(76, 18) == -18076);
+        CHECK(m[Point2i {3, 5}] == -5003);
+        CHECK(min(m) == -18076);
+        CHECK(max(m) == 0);
+
+        const auto halves = transformMatrix<int, double>(m, [](int i) {
+            return i / 2.0;
+        });
+        CHECK(halves.at(10, 10) == -5005.0);
+
+        // padding is not inside the matrix
+        CHECK_THROWS(m.at(77, 0));
+        CHECK_THROWS(m.at(0, 19));
+        CHECK_THROWS(m.at(-1, 0));
+    }
+}
+
+TEST_CASE("Aligned matrix with padded rows", "[utils]")
+{
+    AlignedMatrix<float> m(37, 5);
+
+    // 37 floats padded to 64-byte blocks
+    REQUIRE(m.rowStride() == 48);
+
+    m.generate([](const Point2i &p) {
+        return static_cast<float>(p.y * 100 + p.x);
+    });
+
+    for (auto y = 0; y < m.getYSize(); ++y) {
+        const auto row = m.row(y);
+        CHECK(reinterpret_cast<std::uintptr_t>(row.data()) % 64 == 0);
+        CHECK(row.size() == 37);
+        CHECK(row[36] == static_cast<float>(y * 100 + 36));
+        CHECK(m.paddedRow(y).size() == 48);
+    }
+
+    // Kernels may scribble over the padding without affecting the matrix
+    for (auto &v : m.paddedRow(2).subspan(37))
+        v = -1000;
+
+    CHECK(min(m) == 0);
+    CHECK(m.at(36, 4) == 436);
+    CHECK_THROWS(m.at(37, 0));
+
+    int count = 0;
+    m.foreachValue([&](float) {
+        ++count;
+    });
+    CHECK(count == 37 * 5);
+
+    // Elements that don't divide the alignment
+    const PaddedRowLayout<64> layout({5, 2}, 12);
+    CHECK(layout.rowStride() == 16);
+}
+
+TEMPLATE_TEST_CASE("Matrix statistics", "[utils]", RowMajorLayout, TiledLayout<8>)
+{
+    Matrix<double, TestType> m(37, 23);
+    m.generate([](const Point2i &p) {
+        return 1e6 + (p.x * 7 + p.y * 13) % 17;
+    });
+
+    // reference, the slow way
+    const auto reference = [&](const Point2i &origin, const Point2i &size) {
+        std::vector<double> values;
+        for (auto y = origin.y; y < origin.y + size.y; ++y) {
+            for (auto x = origin.x; x < origin.x + size.x; ++x)
+                values.push_back(m.at(x, y));
+        }
+
+        double sum = 0;
+        for (const auto v : values)
+            sum += v;
+        const auto mean = sum / static_cast<double>(values.size());
+
+        double squares = 0;
+        for (const auto v : values)
+            squares += (v - mean) * (v - mean);
+
+        return std::array {*std::min_element(values.begin(), values.end()),
+                           *std::max_element(values.begin(), values.end()), sum, mean,
+                           squares / static_cast<double>(values.size())};
+    };
+
+    const auto check = [](const Statistics<double> &stats, const std::array<double, 5> &expected) {
+        CHECK(stats.min == expected[0]);
+        CHECK(stats.max == expected[1]);
+        CHECK(stats.sum == Catch::Approx(expected[2]).epsilon(1e-12));
+        CHECK(stats.mean() == Catch::Approx(expected[3]).epsilon(1e-12));
+        CHECK(stats.variance() == Catch::Approx(expected[4]).epsilon(1e-9));
+    };
+
+    SECTION("Whole matrix")
+    {
+        const auto stats = statistics(m);
+        CHECK(stats.count == 37 * 23);
+        CHECK(stats.histogram.empty());
+        check(stats, reference({0, 0}, m.getSize()));
+        check(statistics(ParallelPolicy {3}, m), reference({0, 0}, m.getSize()));
+    }
+
+    SECTION("Rectangle")
+    {
+        const auto stats = statistics(m, {3, 5}, {11, 9});
+        CHECK(stats.count == 11 * 9);
+        check(stats, reference({3, 5}, {11, 9}));
+        check(statistics(ParallelPolicy {2}, m, {3, 5}, {11, 9}), reference({3, 5}, {11, 9}));
+
+        CHECK(statistics(m, {36, 22}, {0, 5}).count == 0);
+        CHECK_THROWS_AS(statistics(m, {30, 0}, {8, 1}), std::out_of_range);
+    }
+
+    SECTION("Histogram")
+    {
+        const auto stats = statistics(m, HistogramBins {17, 1e6, 1e6 + 17});
+        REQUIRE(stats.histogram.size() == 17);
+
+        std::size_t total = 0;
+        for (std::size_t b = 0; b < stats.histogram.size(); ++b) {
+            std::size_t expected = 0;
+            m.foreachValue([&](double v) {
+                expected += v == 1e6 + static_cast<double>(b);
+            });
+            CHECK(stats.histogram[b] == expected);
+            total += stats.histogram[b];
+        }
+        CHECK(total == stats.count);
+
+        // over [min, max], values outside a given range go to the first and last bins
+        CHECK(statistics(m, HistogramBins {17}).histogram == stats.histogram);
+        CHECK(statistics(ParallelPolicy {4}, m, HistogramBins {17}).histogram == stats.histogram);
+        CHECK(statistics(m, HistogramBins {2, 1e6 + 1, 1e6 + 2}).histogram ==
+              std::vector<std::size_t> {stats.histogram[0] + stats.histogram[1],
+                                        stats.count - stats.histogram[0] - stats.histogram[1]});
+    }
+
+    SECTION("Histogram of equal values")
+    {
+        Matrix<double> flat(9, 7);
+        flat.fill(2.5);
+
+        // every value in the first bin
+        const std::vector<std::size_t> expected {9 * 7, 0, 0, 0};
+        CHECK(statistics(flat, HistogramBins {4}).histogram == expected);
+        CHECK(statistics(ParallelPolicy {3}, flat, HistogramBins {4}).histogram == expected);
+        CHECK(CachedStatistics(flat, HistogramBins {4}).get().histogram == expected);
+        CHECK(statistics(m, {5, 5}, {1, 1}, HistogramBins {3}).histogram ==
+              std::vector<std::size_t> {1, 0, 0});
+    }
+}
+
+TEST_CASE("Matrix revision tracks modifications", "[utils]")
+{
+    Matrix<int> m(4, 4);
+    const auto &cm = m;
+
+    auto revision = m.getRevision();
+    const auto changed = [&] {
+        const auto current = m.getRevision();
+        const auto ret = current != revision;
+        revision = current;
+        return ret;
+    };
+
+    (void)cm.at(1, 1);
+    (void)m[{1, 1}];
+    CHECK_FALSE(changed());
+
+    m.at(1, 1) = 5;
+    CHECK(changed());
+    m.fill(1);
+    CHECK(changed());
+    m.transform(ParallelPolicy {2}, [](int v) {
+        return v + 1;
+    });
+    CHECK(changed());
+
+    m.row(2)[0] = 3;
+    CHECK_FALSE(changed());
+    m.markModified();
+    CHECK(changed());
+
+    Matrix<int> other(4, 4);
+    m = other;
+    CHECK(changed());
+}
+
+TEST_CASE("Cached statistics follow the matrix", "[utils]")
+{
+    Matrix<int> m(10, 10);
+    m.fill(3);
+
+    CachedStatistics stats(m);
+    CHECK(stats.get().max == 3);
+    CHECK(&stats.get() == &stats.get());
+
+    m.at(4, 4) = 8;
+    CHECK(stats.get().max == 8);
+    CHECK(stats.get().sum == 99 * 3 + 8);
+}
+
+TEST_CASE("Matrix tracks modified tiles", "[utils]")
+{
+    using Tiles = std::vector<std::pair<Point2i, Point2i>>;
+
+    Matrix<int> m(100, 70);
+    m.trackModifiedTiles(32);
+    CHECK(m.getModifiedTileSize() == 32);
+    CHECK_THROWS_AS(m.trackModifiedTiles(48), std::invalid_argument);
+
+    auto       since = m.getRevision();
+    const auto modified = [&](const auto &matrix) {
+        Tiles tiles;
+        matrix.foreachModifiedTile(since, [&](const Point2i &origin, const Point2i &size) {
+            tiles.emplace_back(origin, size);
+        });
+        return tiles;
+    };
+
+    CHECK(modified(m).empty());
+
+    // tiles are clipped to the matrix
+    m.at(40, 65) = 1;
+    m.at(41, 66) = 1;
+    CHECK(modified(m) == Tiles {{{32, 64}, {32, 6}}});
+
+    since = m.getRevision();
+    m[{95, 5}] = 2;
+    CHECK(modified(m).empty());
+    m.markModified({90, -10}, {20, 20});
+    CHECK(modified(m) == Tiles {{{64, 0}, {32, 32}}, {{96, 0}, {4, 32}}});
+
+    since = m.getRevision();
+    m.fill(0);
+    CHECK(modified(m).size() == 4 * 3);
+
+    SECTION("Views see the tiles in them")
+    {
+        const MatrixView view(m, {30, 30}, {20, 20});
+
+        since = m.getRevision();
+        m.at(80, 10) = 3;
+        CHECK(modified(view).empty());
+
+        view.at(5, 5) = 3;
+        CHECK(modified(view) == Tiles {{{2, 2}, {18, 18}}});
+
+        since = m.getRevision();
+        view.markModified({5, 5}, {100, 4});
+        CHECK(modified(m) == Tiles {{{32, 32}, {32, 32}}});
+    }
+
+    SECTION("Copies keep tracking")
+    {
+        const auto copy = m;
+        since = copy.getRevision();
+        CHECK(copy.getModifiedTileSize() == 32);
+        CHECK(modified(copy).empty());
+    }
+
+    SECTION("Without tracking, the matrix is one tile")
+    {
+        Matrix<int> plain(10, 10);
+        since = plain.getRevision();
+        plain.at(1, 1) = 1;
+        CHECK(plain.getModifiedTileSize() == 0);
+        CHECK(modified(plain) == Tiles {{{0, 0}, {10, 10}}});
+    }
+}
+
+TEMPLATE_TEST_CASE("Cached statistics read modified tiles again", "[utils]", RowMajorLayout,
+                   TiledLayout<8>)
+{
+    Matrix<double, TestType> m(150, 100);
+    m.generate([](const Point2i &p) {
+        return p.x * 0.5 - p.y;
+    });
+    m.trackModifiedTiles(16);
+
+    const HistogramBins bins {10, -100.0, 100.0};
+
+    CachedStatistics full(m, bins);
+    CachedStatistics part(MatrixView(m, {7, 9}, {100, 60}), bins);
+    (void)full.get();
+    (void)part.get();
+
+    const auto check = [](const Statistics<double> &stats, const Statistics<double> &expected) {
+        CHECK(stats.min == expected.min);
+        CHECK(stats.max == expected.max);
+        CHECK(stats.count == expected.count);
+        CHECK(stats.sum == Catch::Approx(expected.sum));
+        CHECK(stats.variance() == Catch::Approx(expected.variance()));
+        CHECK(stats.histogram == expected.histogram);
+    };
+    const auto checkBoth = [&] {
+        check(full.get(), statistics(m, bins));
+        check(part.get(), statistics(m, {7, 9}, {100, 60}, bins));
+    };
+
+    m.at(20, 20) = 500;
+    m.at(149, 99) = -500;
+    checkBoth();
+
+    m[{60, 30}] = -250;
+    m.markModified({60, 30}, {1, 1});
+    checkBoth();
+
+    m.transform([](double v) {
+        return v < -90 ? v + 10 : v;
+    });
+    checkBoth();
+}
+
+TEST_CASE("Normalize matrix", "[utils]")
+{
+    Matrix<float> m(20, 10);
+    m.generate([](const Point2i &p) {
+        return static_cast<float>(p.x - 2 * p.y);
+    });
+
+    normalize(m);
+    CHECK(min(m) == 0.0f);
+    CHECK(max(m) == 1.0f);
+    CHECK(m.at(19, 0) == 1.0f);
+    CHECK(m.at(0, 9) == 0.0f);
+
+    normalize(ParallelPolicy {2}, m, -1.0f, 1.0f);
+    CHECK(m.at(19, 0) == 1.0f);
+    CHECK(m.at(0, 9) == -1.0f);
+
+    m.fill(7.0f);
+    normalize(m, 2.0f, 4.0f);
+    CHECK(max(m) == 2.0f);
+}
+
+TEMPLATE_TEST_CASE("Matrix views", "[utils]", RowMajorLayout, PaddedRowLayout<64>, TiledLayout<8>)
+{
+    Matrix<int, TestType> m(30, 20);
+    m.generate([](const Point2i &p) {
+        return p.y * 100 + p.x;
+    });
+
+    const MatrixView view(m, {5, 3}, {10, 8});
+    REQUIRE(view.getSize() == Point2i {10, 8});
+    CHECK(view.getOrigin() == Point2i {5, 3});
+
+    SECTION("Access is relative to the origin")
+    {
+        CHECK(view.at(0, 0) == 305);
+        CHECK(view[{9, 7}] == 1014);
+        CHECK_THROWS_AS(view.at(10, 0), std::out_of_range);
+        CHECK_THROWS_AS(view.at(0, -1), std::out_of_range);
+
+        int count = 0;
+        view.foreachKeyValue([&](const Point2i &p, int v) {
+            count += v == m.at(p + Point2i {5, 3});
+        });
+        CHECK(count == 80);
+
+        if constexpr (TestType::contiguousRows) {
+            CHECK(view.row(2)[4] == 509);
+            CHECK(view.row(2).size() == 10);
+        }
+    }
+
+    SECTION("Writes go to the matrix")
+    {
+        const auto revision = m.getRevision();
+        view.fill(-1);
+        CHECK(m.getRevision() != revision);
+
+        view.subview({2, 2}, {3, 3}).generate([](const Point2i &p) {
+            return p.x + 10 * p.y;
+        });
+
+        CHECK(m.at(5, 3) == -1);
+        CHECK(m.at(14, 10) == -1);
+        CHECK(m.at(15, 10) == 1015);
+        CHECK(m.at(4, 3) == 304);
+        CHECK(m.at(7, 5) == 0);
+        CHECK(m.at(9, 7) == 22);
+        CHECK(m.at(10, 7) == -1);
+    }
+
+    SECTION("Views must be inside the matrix")
+    {
+        CHECK_THROWS_AS(MatrixView(m, {25, 0}, {6, 1}), std::out_of_range);
+        CHECK_THROWS_AS(MatrixView(m, {-1, 0}, {1, 1}), std::out_of_range);
+        CHECK_THROWS_AS(view.subview({8, 0}, {3, 1}), std::out_of_range);
+        CHECK(MatrixView(m, {30, 20}, {0, 0}).getSize() == Point2i {0, 0});
+    }
+
+    SECTION("Read-only views")
+    {
+        const auto                           &cm = m;
+        const MatrixView<const int, TestType> readOnly = view;
+        CHECK(MatrixView(cm).at(29, 19) == 1929);
+        CHECK(readOnly.at(1, 1) == 406);
+
+        const auto revision = m.getRevision();
+        (void)readOnly.at(1, 1);
+        CHECK(m.getRevision() == revision);
+    }
+
+    SECTION("Statistics")
+    {
+        const auto fromView = statistics(view);
+        const auto fromMatrix = statistics(m, {5, 3}, {10, 8});
+        CHECK(fromView.sum == fromMatrix.sum);
+        CHECK(fromView.min == 305);
+        CHECK(max(view) == 1014);
+    }
+
+    SECTION("Tiles in parallel")
+    {
+        std::atomic<int> tiles {0};
+        parallelFor(6, 3, [&](int tile, int) {
+            const auto tileView = MatrixView(m, {tile % 3 * 10, tile / 3 * 10}, {10, 10});
+            tileView.transform([](int v) {
+                return -v;
+            });
+            ++tiles;
+        });
+
+        CHECK(tiles == 6);
+        CHECK(m.at(29, 19) == -1929);
+        CHECK(m.at(0, 0) == 0);
+        CHECK(m.at(11, 12) == -1211);
+    }
+}
@@ -0,0 +1,192 @@
+#include "MatrixFile.h"
+#include "Noise.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+using namespace mist;
+
+namespace
+{
+
+// Temporary file, removed at the end of the test
+class TempFile
+{
+public:
+    explicit TempFile(const std::string &name)
+        : path(std::filesystem::temp_directory_path() / ("mist_utest_" + name))
+    {
+    }
+    ~TempFile() { std::filesystem::remove(path); }
+
+    TempFile(const TempFile &) = delete;
+    auto operator=(const TempFile &) -> TempFile & = delete;
+
+    std::filesystem::path path;
+};
+
+template <typename T, class Layout = RowMajorLayout>
+auto makeTestMatrix(int xSize, int ySize) -> Matrix<T, Layout>
+{
+    Matrix<T, Layout> m(xSize, ySize);
+    m.generate([](const Point2i &p) {
+        return static_cast<T>(p.y * 100 + p.x - 1000);
+    });
+    return m;
+}
+
+} // namespace
+
+TEST_CASE("Matrix files round trip", "[matrixfile]")
+{
+    TempFile file("roundtrip.mat");
+
+    SECTION("double")
+    {
+        const auto m = makeTestMatrix<double>(33, 17);
+        saveMatrix(file.path, m);
+
+        CHECK(std::filesystem::file_size(file.path) == 64 + 33 * 17 * sizeof(double));
+
+        const auto loaded = loadMatrix<double>(file.path);
+        REQUIRE(loaded.getSize() == m.getSize());
+        m.foreachKeyValue([&](const Point2i &p, double v) {
+            CHECK(loaded.at(p) == v);
+        });
+    }
+
+    SECTION("int16 into a tiled layout")
+    {
+        const auto m = makeTestMatrix<std::int16_t>(70, 9);
+        saveMatrix(file.path, m);
+
+        const auto loaded = loadMatrix<std::int16_t, TiledLayout<16>>(file.path);
+        m.foreachKeyValue([&](const Point2i &p, std::int16_t v) {
+            CHECK(loaded.at(p) == v);
+        });
+    }
+
+    SECTION("Point2 from a tiled layout")
+    {
+        Matrix<Point2f, MortonLayout<8>> m(20, 30);
+        m.generate([](const Point2i &p) {
+            return Point2f {static_cast<float>(p.x) * 0.5f, static_cast<float>(p.y) * -2.0f};
+        });
+        saveMatrix(file.path, m);
+
+        const auto loaded = loadMatrix<Point2f>(file.path);
+        m.foreachKeyValue([&](const Point2i &p, const Point2f &v) {
+            CHECK(loaded.at(p) == v);
+        });
+    }
+}
+
+TEST_CASE("Memory-mapped matrix", "[matrixfile]")
+{
+    TempFile   file("mapped.mat");
+    const auto m = makeTestMatrix<float>(41, 23);
+    saveMatrix(file.path, m);
+
+    const MappedMatrix<float> mapped(file.path);
+    REQUIRE(mapped.getSize() == m.getSize());
+    CHECK(mapped.row(22)[40] == m.at(40, 22));
+    CHECK(mapped[Point2i {3, 4}] == m.at(3, 4));
+    CHECK_THROWS_AS(mapped.at(41, 0), std::out_of_range);
+
+    mapped.foreachKeyValue([&](const Point2i &p, float v) {
+        CHECK(v == m.at(p));
+    });
+}
+
+TEST_CASE("Matrix files are validated", "[matrixfile]")
+{
+    TempFile file("invalid.mat");
+    saveMatrix(file.path, makeTestMatrix<double>(8, 8));
+
+    CHECK_THROWS_AS(loadMatrix<float>(file.path), MatrixFileError);
+    CHECK_THROWS_AS(loadMatrix<Point2d>(file.path), MatrixFileError);
+    CHECK_THROWS_AS(MappedMatrix<std::int64_t>(file.path), MatrixFileError);
+
+    SECTION("Truncated")
+    {
+        std::filesystem::resize_file(file.path, 64 + 8 * 8 * sizeof(double) - 1);
+        CHECK_THROWS_AS(loadMatrix<double>(file.path), MatrixFileError);
+        CHECK_THROWS_AS(MappedMatrix<double>(file.path), MatrixFileError);
+    }
+
+    SECTION("Data past the end of the file")
+    {
+        // the end of the data would wrap around to inside the file
+        auto header = makeMatrixFileHeader<double>({8, 8});
+        header.dataOffset = std::numeric_limits<std::uint64_t>::max() - 7;
+        CHECK_THROWS_AS(checkMatrixFileHeader<double>(header, 64 + 8 * 8 * sizeof(double)),
+                        MatrixFileError);
+
+        std::fstream f(file.path, std::ios::binary | std::ios::in | std::ios::out);
+        f.seekp(offsetof(MatrixFileHeader, dataOffset));
+        f.write(reinterpret_cast<const char *>(&header.dataOffset), sizeof(header.dataOffset));
+        f.close();
+        CHECK_THROWS_AS(loadMatrix<double>(file.path), MatrixFileError);
+        CHECK_THROWS_AS(MappedMatrix<double>(file.path), MatrixFileError);
+    }
+
+    SECTION("Sizes too large for a file")
+    {
+        // xSize * ySize * sizeof(double) doesn't fit in 64 bits
+        auto header = makeMatrixFileHeader<double>({8, 8});
+        header.xSize = std::numeric_limits<std::int32_t>::max();
+        header.ySize = std::numeric_limits<std::int32_t>::max();
+        CHECK_THROWS_AS(checkMatrixFileHeader<double>(header, 64 + 8 * 8 * sizeof(double)),
+                        MatrixFileError);
+    }
+
+    SECTION("Not a matrix file")
+    {
+        std::ofstream(file.path) << "hello";
+        CHECK_THROWS_AS(loadMatrix<double>(file.path), MatrixFileError);
+        CHECK_THROWS_AS(MappedMatrix<double>(file.path), MatrixFileError);
+    }
+
+    SECTION("Newer version")
+    {
+        std::fstream f(file.path, std::ios::binary | std::ios::in | std::ios::out);
+        const std::uint32_t version = 99;
+        f.seekp(8);
+        f.write(reinterpret_cast<const char *>(&version), sizeof(version));
+        f.close();
+        CHECK_THROWS_AS(loadMatrix<double>(file.path), MatrixFileError);
+    }
+}
+
+TEST_CASE("Matrix file writer streams tiles", "[matrixfile]")
+{
+    TempFile     file("streamed.mat");
+    PerlinNoise2 perlin(0.5);
+
+    Matrix<double> whole(150, 97);
+    NoiseTextureBuilder2<double>(whole, perlin).setXScale(8).setYScale(5).build();
+
+    {
+        MatrixFileWriter<double> writer(file.path, {150, 97});
+        NoiseStreamBuilder2<double>({150, 97}, perlin)
+            .setXScale(8)
+            .setYScale(5)
+            .setTileSize({40, 32})
+            .setThreadCount(3)
+            .build([&](const Point2i &origin, const Matrix<double> &tile) {
+                writer.writeTile(origin, tile);
+            });
+
+        CHECK_THROWS_AS(writer.writeTile({140, 0}, Matrix<double>(11, 1)), std::out_of_range);
+    }
+
+    const MappedMatrix<double> mapped(file.path);
+    whole.foreachKeyValue([&](const Point2i &p, double v) {
+        CHECK(mapped.at(p) == v);
+    });
+}
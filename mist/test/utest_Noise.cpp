@@ -0,0 +1,348 @@
+#include "Noise.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace mist;
+using namespace Catch::Matchers;
+
+namespace
+{
+
+template <typename T = double> auto makeTestPoints(int n) -> std::vector<Point2<T>>
+{
+    std::vector<Point2<T>> points;
+    for (int i = 0; i < n; ++i)
+        points.push_back(Point2d {-3.7 + i * 0.173, 11.2 - i * 0.061}.as<T>());
+
+    // integer coordinates and wrap-around of the permutation table
+    points.push_back(Point2d {2.0, -7.0}.as<T>());
+    points.push_back(Point2d {255.5, 256.25}.as<T>());
+    points.push_back(Point2d {-512.75, 1023.5}.as<T>());
+    return points;
+}
+
+template <typename T> auto checkBatchMatchesSingle(BasicNoise2<T> &noise, double margin) -> void
+{
+    auto           points = makeTestPoints<T>(600);
+    std::vector<T> out(points.size());
+    noise.sampleMany(points, out);
+
+    for (std::size_t i = 0; i < points.size(); ++i)
+        CHECK_THAT(out[i], WithinAbs(noise.sample(points[i]), margin));
+}
+
+auto checkBatchMatchesSingle(Noise2 &noise) -> void
+{
+    checkBatchMatchesSingle(noise, 1e-12);
+}
+
+// Hides the concrete type of a noise, so composite noises take their generic path
+template <typename T> class Opaque : public BasicNoise2<T>
+{
+public:
+    Opaque(BasicNoise2<T> &noise_) : noise(noise_) {}
+    auto sample(const Point2<T> &p) -> T override { return noise.sample(p); }
+
+private:
+    BasicNoise2<T> &noise;
+};
+
+} // namespace
+
+TEST_CASE("Noise batch sampling matches single samples", "[noise]")
+{
+    PerlinNoise2 perlin(0.5);
+
+    SECTION("Perlin") { checkBatchMatchesSingle(perlin); }
+
+    SECTION("Simplex")
+    {
+        SimplexNoise2 simplex;
+        checkBatchMatchesSingle(simplex);
+    }
+
+    SECTION("Octaves")
+    {
+        OctaveNoise2 octaves(perlin);
+        octaves.setNumOctaves(4).setRoughness(0.6);
+        checkBatchMatchesSingle(octaves);
+    }
+
+    SECTION("Domain warped")
+    {
+        DomainWarpedNoise2 warped(perlin);
+        checkBatchMatchesSingle(warped);
+    }
+}
+
+TEST_CASE("Vectorized Perlin matches the scalar path", "[noise]")
+{
+    const auto   supported = getNoiseSimdLevel();
+    PerlinNoise2 perlin(-3.3);
+
+    for (auto level : {SimdLevel::None, SimdLevel::Sse41, SimdLevel::Avx2}) {
+        if (level > supported) continue;
+        CHECK(setNoiseSimdLevel(level) == level);
+        checkBatchMatchesSingle(perlin);
+
+        PerlinNoise2f perlinf(-3.3f);
+        checkBatchMatchesSingle(perlinf, 1e-5);
+
+        // integer z takes the 2D path
+        PerlinNoise2  flat(2);
+        PerlinNoise2f flatf(-1);
+        checkBatchMatchesSingle(flat);
+        checkBatchMatchesSingle(flatf, 1e-5);
+    }
+
+    setNoiseSimdLevel(supported);
+}
+
+TEST_CASE("Perlin at integer z matches the 3D evaluation", "[noise]")
+{
+    // fade(1e-300) underflows to 0, so this takes the 3D path to the same result
+    PerlinNoise2 flat(0);
+    PerlinNoise2 full(1e-300);
+
+    for (const auto &p : makeTestPoints(300))
+        CHECK_THAT(flat.sample(p), WithinAbs(full.sample(p), 1e-12));
+}
+
+TEST_CASE("Simplex noise", "[noise]")
+{
+    SimplexNoise2 simplex;
+    double        lo = 0;
+    double        hi = 0;
+
+    for (int y = 0; y < 200; ++y) {
+        for (int x = 0; x < 200; ++x) {
+            const Point2d p {x * 0.0731 - 5, y * 0.0693 - 3};
+            const auto    n = simplex.sample(p);
+            lo = std::min(lo, n);
+            hi = std::max(hi, n);
+
+            // continuous: a small step changes the value only a little
+            CHECK_THAT(simplex.sample(p + Point2d {1e-4, 1e-4}), WithinAbs(n, 2e-3));
+        }
+    }
+
+    CHECK(lo >= -1);
+    CHECK(hi <= 1);
+    CHECK(lo < -0.5);
+    CHECK(hi > 0.5);
+
+    SECTION("Seeding")
+    {
+        const Point2d p {1.7, -2.3};
+        SimplexNoise2 a;
+        SimplexNoise2 b(PerlinPermutation(7));
+        a.setSeed(7);
+        CHECK(a.sample(p) == b.sample(p));
+        CHECK(a.sample(p) != simplex.sample(p));
+    }
+}
+
+TEST_CASE("Octave noise", "[noise]")
+{
+    PerlinNoise2 perlin(0.25);
+    Opaque       opaque(perlin);
+    auto         points = makeTestPoints(300);
+
+    SECTION("fBm sums scaled octaves")
+    {
+        OctaveNoise2 octaves(perlin);
+        octaves.setNumOctaves(3).setRoughness(0.5).setFrequencyMultiplier(3);
+
+        for (const auto &p : points) {
+            const double G = std::pow(2.0, -0.5);
+            const double expected = perlin.sample(p) + G * perlin.sample(p * 3.0) +
+                                    G * G * perlin.sample(p * 9.0);
+            CHECK_THAT(octaves.sample(p), WithinAbs(expected, 1e-12));
+        }
+    }
+
+    SECTION("Fused Perlin path matches the generic path")
+    {
+        const auto supported = getNoiseSimdLevel();
+
+        for (auto mode : {OctaveMode::Fbm, OctaveMode::Ridged, OctaveMode::Billow}) {
+            OctaveNoise2 fused(perlin);
+            OctaveNoise2 generic(opaque);
+            fused.setNumOctaves(4).setMode(mode);
+            generic.setNumOctaves(4).setMode(mode);
+
+            for (auto level : {SimdLevel::None, SimdLevel::Sse41, SimdLevel::Avx2}) {
+                if (level > supported) continue;
+                setNoiseSimdLevel(level);
+
+                std::vector<double> a(points.size());
+                std::vector<double> b(points.size());
+                fused.sampleMany(points, a);
+                generic.sampleMany(points, b);
+
+                for (std::size_t i = 0; i < points.size(); ++i) {
+                    CHECK_THAT(a[i], WithinAbs(b[i], 1e-12));
+                    CHECK_THAT(fused.sample(points[i]), WithinAbs(b[i], 1e-12));
+                }
+            }
+        }
+
+        setNoiseSimdLevel(supported);
+    }
+
+    SECTION("Ridged and billow shapes")
+    {
+        OctaveNoise2 ridged(perlin);
+        OctaveNoise2 billow(perlin);
+        ridged.setNumOctaves(1).setMode(OctaveMode::Ridged);
+        billow.setNumOctaves(1).setMode(OctaveMode::Billow);
+
+        for (const auto &p : points) {
+            const auto n = perlin.sample(p);
+            const auto r = 1 - std::abs(n);
+            CHECK_THAT(ridged.sample(p), WithinAbs(r * r * 2 - 1, 1e-12));
+            CHECK_THAT(billow.sample(p), WithinAbs(std::abs(n) * 2 - 1, 1e-12));
+        }
+    }
+}
+
+TEST_CASE("Float noise matches the double reference", "[noise]")
+{
+    PerlinNoise2  perlin(0.5);
+    PerlinNoise2f perlinf(0.5f);
+
+    auto points = makeTestPoints(300);
+    for (const auto &p : points) {
+        if (std::abs(p.x) > 100 || std::abs(p.y) > 100) continue;
+        CHECK_THAT(perlinf.sample(p.as<float>()), WithinAbs(perlin.sample(p), 1e-4));
+    }
+
+    SECTION("Octaves")
+    {
+        OctaveNoise2  octaves(perlin);
+        OctaveNoise2f octavesf(perlinf);
+
+        Matrix<double> reference(64, 64);
+        Matrix<float>  texture(64, 64);
+        NoiseTextureBuilder2<double>(reference, octaves).setXScale(4).setYScale(4).build();
+        NoiseTextureBuilder2<float, float>(texture, octavesf).setXScale(4).setYScale(4).build();
+
+        texture.foreachKeyValue([&](const Point2i &p, float v) {
+            CHECK_THAT(v, WithinAbs(reference.at(p), 1e-4));
+        });
+    }
+
+    SECTION("Domain warped")
+    {
+        DomainWarpedNoise2  warped(perlin);
+        DomainWarpedNoise2f warpedf(perlinf);
+        checkBatchMatchesSingle(warpedf, 1e-5);
+
+        for (const auto &p : makeTestPoints(100))
+            CHECK_THAT(warpedf.sample(p.as<float>()), WithinAbs(warped.sample(p), 1e-4));
+    }
+}
+
+TEST_CASE("Perlin generators are seeded independently", "[noise]")
+{
+    const Point2d p {1.37, 4.21};
+
+    PerlinNoise2 a;
+    PerlinNoise2 b;
+    const auto   reference = a.sample(p);
+
+    b.setSeed(42);
+    CHECK(a.sample(p) == reference);
+    CHECK(b.sample(p) != reference);
+
+    PerlinNoise2 c(PerlinPermutation(42));
+    CHECK(c.sample(p) == b.sample(p));
+
+    checkBatchMatchesSingle(b);
+}
+
+TEST_CASE("Noise texture builder", "[noise]")
+{
+    PerlinNoise2   perlin(0.5);
+    Matrix<double> texture(37, 21);
+
+    NoiseTextureBuilder2<double>(texture, perlin).setXScale(4).setYScale(3).build();
+
+    texture.foreachKeyValue([&](const Point2i &p, double v) {
+        const Point2d pRel {static_cast<double>(p.x) / 37.0 * 4,
+                            static_cast<double>(p.y) / 21.0 * 3};
+        CHECK(v == std::clamp(perlin.sample(pRel), -1.0, 1.0));
+    });
+}
+
+TEST_CASE("Parallel noise texture build is deterministic", "[noise]")
+{
+    PerlinNoise2 perlin(0.5);
+    OctaveNoise2 octaves(perlin);
+
+    Matrix<double> serial(150, 97);
+    Matrix<double> parallel(150, 97);
+
+    NoiseTextureBuilder2<double>(serial, octaves).setXScale(8).setYScale(5).build();
+    NoiseTextureBuilder2<double>(parallel, octaves)
+        .setXScale(8)
+        .setYScale(5)
+        .setThreadCount(4)
+        .build();
+
+    serial.foreachKeyValue([&](const Point2i &p, double v) {
+        CHECK(parallel.at(p) == v);
+    });
+}
+
+TEST_CASE("Streamed noise tiles match the whole texture", "[noise]")
+{
+    PerlinNoise2 perlin(0.5);
+    OctaveNoise2 octaves(perlin);
+
+    Matrix<double> whole(150, 97);
+    NoiseTextureBuilder2<double>(whole, octaves).setXScale(8).setYScale(5).build();
+
+    Matrix<double>       stitched(150, 97);
+    Matrix<int>          coverage(150, 97);
+    std::vector<Point2i> tileSizes;
+    std::mutex           mutex;
+
+    NoiseStreamBuilder2<double>({150, 97}, octaves)
+        .setXScale(8)
+        .setYScale(5)
+        .setTileSize({40, 32})
+        .setThreadCount(3)
+        .build([&](const Point2i &origin, const Matrix<double> &tile) {
+            const std::lock_guard lock(mutex);
+            tileSizes.push_back(tile.getSize());
+            tile.foreachKeyValue([&](const Point2i &p, double v) {
+                stitched.at(origin + p) = v;
+                ++coverage.at(origin + p);
+            });
+        });
+
+    // Catch isn't thread-safe, so only check from this thread
+    for (const auto &size : tileSizes) {
+        CHECK(size.x <= 40);
+        CHECK(size.y <= 32);
+    }
+    whole.foreachKeyValue([&](const Point2i &p, double v) {
+        CHECK(stitched.at(p) == v);
+        CHECK(coverage.at(p) == 1);
+    });
+}
+
+TEST_CASE("Streamed noise tiles must have a size", "[noise]")
+{
+    PerlinNoise2                perlin(0.5);
+    NoiseStreamBuilder2<double> builder({150, 97}, perlin);
+
+    CHECK_THROWS_AS(builder.setTileSize({0, 32}), std::invalid_argument);
+    CHECK_THROWS_AS(builder.setTileSize({40, -1}), std::invalid_argument);
+}
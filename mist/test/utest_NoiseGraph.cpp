@@ -0,0 +1,94 @@
+#include "NoiseGraph.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include <vector>
+
+using namespace mist;
+using namespace Catch::Matchers;
+
+namespace
+{
+
+auto makeTestPoints() -> std::vector<Point2d>
+{
+    std::vector<Point2d> points;
+    for (int i = 0; i < 333; ++i)
+        points.push_back({-2.1 + i * 0.093, 7.4 - i * 0.037});
+    return points;
+}
+
+template <class Graph> auto checkGraphMatches(Graph &graph, Noise2 &reference) -> void
+{
+    const auto          points = makeTestPoints();
+    std::vector<double> out(points.size());
+    graph.sampleMany(points, out);
+
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        const auto expected = reference.sample(points[i]);
+        CHECK_THAT(graph.sample(points[i]), WithinAbs(expected, 1e-12));
+        CHECK_THAT(out[i], WithinAbs(expected, 1e-12));
+    }
+}
+
+} // namespace
+
+TEST_CASE("Compile-time noise graphs match virtual chains", "[noise]")
+{
+    PerlinNoise2 perlin(0.5);
+
+    SECTION("Octave<Perlin>")
+    {
+        OctaveNoise2 reference(perlin);
+        reference.setNumOctaves(3).setMode(OctaveMode::Billow);
+
+        compose::Octave<PerlinNoise2> graph(perlin);
+        graph.setNumOctaves(3).setMode(OctaveMode::Billow);
+
+        checkGraphMatches(graph, reference);
+    }
+
+    SECTION("Warp<Octave<Perlin>>")
+    {
+        OctaveNoise2       octaves(perlin);
+        DomainWarpedNoise2 reference(octaves);
+        octaves.setNumOctaves(4);
+
+        compose::Warp<compose::Octave<PerlinNoise2>> graph {compose::Octave<PerlinNoise2>(perlin)};
+        graph.source().setNumOctaves(4);
+
+        checkGraphMatches(graph, reference);
+    }
+
+    SECTION("Octave<Warp<Perlin>>")
+    {
+        DomainWarpedNoise2 warped(perlin);
+        OctaveNoise2       reference(warped);
+        reference.setNumOctaves(2);
+
+        compose::Octave<compose::Warp<PerlinNoise2>> graph {compose::Warp<PerlinNoise2>(perlin)};
+        graph.setNumOctaves(2);
+
+        checkGraphMatches(graph, reference);
+    }
+}
+
+TEST_CASE("Noise graph adapter", "[noise]")
+{
+    PerlinNoise2       perlin;
+    OctaveNoise2       octaves(perlin);
+    DomainWarpedNoise2 reference(octaves);
+
+    NoiseAdapter<compose::Warp<compose::Octave<PerlinNoise2>>> adapter;
+    Noise2                                                    &noise = adapter;
+
+    Matrix<double> expected(40, 30);
+    Matrix<double> texture(40, 30);
+    NoiseTextureBuilder2<double>(expected, reference).setXScale(3).build();
+    NoiseTextureBuilder2<double>(texture, noise).setXScale(3).build();
+
+    texture.foreachKeyValue([&](const Point2i &p, double v) {
+        CHECK_THAT(v, WithinAbs(expected.at(p), 1e-12));
+    });
+}
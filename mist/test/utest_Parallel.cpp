@@ -0,0 +1,71 @@
+#include "Parallel.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace mist;
+
+TEST_CASE("parallelFor runs every task once", "[parallel]")
+{
+    for (int threads : {0, 1, 3, 16}) {
+        std::vector<std::atomic<int>> counts(100);
+        std::atomic<int>              badWorker {0};
+
+        parallelFor(100, threads, [&](int task, int worker) {
+            counts[static_cast<std::size_t>(task)]++;
+            if (worker < 0 || (threads > 0 && worker >= threads)) badWorker++;
+        });
+
+        for (const auto &c : counts)
+            CHECK(c == 1);
+        CHECK(badWorker == 0);
+    }
+}
+
+TEST_CASE("parallelFor rethrows task exceptions", "[parallel]")
+{
+    CHECK_THROWS_AS(parallelFor(50, 4,
+                                [](int task, int) {
+                                    if (task == 17) throw std::runtime_error("task failed");
+                                }),
+                    std::runtime_error);
+}
+
+TEST_CASE("WorkerPool runs every task once, call after call", "[parallel]")
+{
+    for (int threads : {0, 1, 3}) {
+        WorkerPool pool(threads);
+        CHECK(pool.getThreadCount() == (threads > 0 ? threads : hardwareThreadCount()));
+
+        for (int numTasks : {0, 1, 2, 100, 7}) {
+            std::vector<std::atomic<int>> counts(static_cast<std::size_t>(numTasks));
+            std::atomic<int>              badWorker {0};
+
+            pool.run(numTasks, [&](int task, int worker) {
+                counts[static_cast<std::size_t>(task)]++;
+                if (worker < 0 || worker >= pool.getThreadCount()) badWorker++;
+            });
+
+            for (const auto &c : counts)
+                CHECK(c == 1);
+            CHECK(badWorker == 0);
+        }
+    }
+}
+
+TEST_CASE("WorkerPool rethrows task exceptions and keeps working", "[parallel]")
+{
+    WorkerPool pool(4);
+    CHECK_THROWS_AS(pool.run(50,
+                             [](int task, int) {
+                                 if (task == 17) throw std::runtime_error("task failed");
+                             }),
+                    std::runtime_error);
+
+    std::atomic<int> count {0};
+    pool.run(50, [&](int, int) { count++; });
+    CHECK(count == 50);
+}